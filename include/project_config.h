@@ -50,6 +50,13 @@
 #define CONFIG_GPIO_ALARM_ZONE_4    14
 #define CONFIG_GPIO_ALARM_ZONE_5    2
 #define CONFIG_GPIO_ALARM_LEVEL     0x01
+// EN: Additional alarm zones on the MCP23017 expander: INT pin (INTA/INTB mirrored, open drain), bus, address, inputs active low, debounce (ms)
+// RU: Дополнительные зоны ОПС на расширителе MCP23017: вывод INT (INTA/INTB объединены, открытый сток), шина, адрес, входы с активным низким уровнем, подавление дребезга (мс)
+// #define CONFIG_GPIO_ZONEEXP_INT     5
+#define CONFIG_ZONEEXP_I2C_PORT     I2C_NUM_0
+#define CONFIG_ZONEEXP_ADDRESS      0x20
+#define CONFIG_ZONEEXP_ACTIVE_LOW   0xFFFF
+#define CONFIG_ZONEEXP_DEBOUNCE_MS  20
 // EN: I2C bus #0: pins, pullup, frequency
 // RU: Шина I2C #0: выводы, подтяжка, частота, размер статического буфера в транзациях
 #define CONFIG_I2C_PORT0_SDA        21
@@ -68,7 +75,10 @@
 // The I2C APIs are not thread-safe, if you want to use one I2C port in different tasks, you need to take care of the multi-thread issue.
 // RU: Блокировка доступа к шинам I2C. Имеет смысл, если доступ к устройствам I2C осущствляется из разных потоков
 // API-интерфейсы I2C не являются потокобезопасными, если вы хотите использовать один порт I2C в разных задачах, вам нужно позаботиться о проблеме многопоточности.
-#define CONFIG_I2C_LOCK 0
+#define CONFIG_I2C_LOCK 1
+// EN: Batched I2C transactions (lib/i2cbatch): max operations per batch
+// RU: Пакетные транзакции I2C (lib/i2cbatch): максимум операций в пакете
+#define CONFIG_I2C_BATCH_MAX_OPS 8
 
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------- EN - Common parameters ----------------------------------------------------
@@ -227,6 +237,19 @@
 // RU: Разрешить периодическую проверку доступности сети интернет с помошью пинга. 
 //     Иногда доступ в сеть может пропасть, но подключение к WiFi при этом работает. В этом случае устройство приостановит все сетевые процессы.
 #define CONFIG_PINGER_ENABLE 1
+#if CONFIG_PINGER_ENABLE
+// EN: Check all hosts in parallel (one common timeout window per packet) instead of the sequential check of rePinger
+// RU: Проверять все хосты параллельно (одно общее окно ожидания на пакет) вместо последовательной проверки rePinger
+#define CONFIG_NETPROBE_ENABLE 1
+// EN: Minimum number of hosts that must respond for the Internet to be considered available
+// RU: Минимальное количество ответивших хостов, при котором интернет считается доступным
+#define CONFIG_NETPROBE_QUORUM 1
+#define CONFIG_NETPROBE_PARAM_QUORUM_KEY "quorum"
+#define CONFIG_NETPROBE_PARAM_QUORUM_FRIENDLY "Кворум хостов"
+// EN: Sliding window size (in packets) for per-host RTT percentiles (p50 / p95) and loss
+// RU: Размер скользящего окна (в пакетах) для расчета перцентилей RTT (p50 / p95) и потерь по каждому хосту
+#define CONFIG_NETPROBE_WINDOW 32
+#endif // CONFIG_PINGER_ENABLE
 
 // EN: Disable network error indication (wifi, internet, openmon, tg...) as the device is not always connected to the network
 // RU: Отключить иникацию сетевых ошибок (wifi, inetnet, openmon, tg...), так как устройство не всегда подключено к сети
@@ -501,4 +524,8 @@
 // RU: Разрешить периодическую публикацию информации о задачах. Должен быть разрешен CONFIG_FREERTOS_USE_TRACE_FACILITY / configUSE_TRACE_FACILITY
 #define CONFIG_MQTT_TASKLIST_ENABLE 0
 #define CONFIG_MQTT_TASKLIST_INTERVAL 1000*60*60
+// EN: Allow periodic publication of hot path latencies (p50 / p99 / max) and minimum task stack on the "perf" topic
+// RU: Разрешить периодическую публикацию задержек "горячих" участков (p50 / p99 / max) и минимального остатка стека задач в топике "perf"
+#define CONFIG_PERFSTAT_ENABLE 1
+#define CONFIG_PERFSTAT_INTERVAL 1000*60*15
 
@@ -0,0 +1,374 @@
+#include "annunciator.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+#include "rLog.h"
+#include "def_consts.h"
+#include "def_tasks.h"
+#include "perfstat.h"
+
+static const char* logTAG = "ANNC";
+static const char* annunciatorTaskName = "annunciator";
+
+// Состояние одного выхода: логика режимов совпадает с логикой задачи ledTaskCreate() из reLed
+typedef struct {
+  const char* name;
+  int8_t gpio;
+  bool high;
+  bool blinkPriority;
+  ledCustomControl_t customControl;
+  QueueHandle_t queue;
+  StaticQueue_t queueBuffer;
+  uint8_t queueStorage[CONFIG_LED_QUEUE_SIZE * sizeof(ledQueueData_t)];
+  bool enabled;
+  bool state;
+  bool alarm;             // Сирена: включение завершает измерение "зона -> сирена"
+  // Время следующего переключения
+  bool timed;
+  TickType_t next;
+  TickType_t wait;
+  // on mode
+  bool on;
+  uint16_t onCount;
+  // flash mode
+  bool flash;
+  uint16_t flashDuration;
+  uint16_t flashQuantity;
+  uint16_t flashInterval;
+  uint16_t flashCount;
+  // blink mode
+  bool blink;
+  uint16_t blinkDuration;
+  uint16_t blinkQuantity;
+  uint16_t blinkInterval;
+  uint16_t blinkCount;
+} annunciator_output_t;
+
+static annunciator_output_t _outputs[CONFIG_ANNUNCIATOR_MAX_OUTPUTS];
+static volatile uint8_t _outputsCount = 0;
+static QueueSetHandle_t _annunciatorSet = nullptr;
+static TaskHandle_t _annunciatorTask = nullptr;
+static StaticTask_t _annunciatorTaskBuffer;
+static StackType_t _annunciatorTaskStack[CONFIG_ANNUNCIATOR_TASK_STACK_SIZE];
+static perf_metric_t _perfAlarm = PERF_METRIC_NONE;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Выход -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void annOutputSetLevel(annunciator_output_t* out, bool newLevel)
+{
+  if (out->gpio > -1) {
+    if (out->customControl == nullptr) {
+      gpio_set_level((gpio_num_t)out->gpio, out->high ? newLevel : !newLevel);
+    } else {
+      out->customControl(out->gpio, (newLevel == out->high));
+    };
+  };
+}
+
+static void annOutputSetState(annunciator_output_t* out, bool newState)
+{
+  if (out->state != newState) {
+    out->state = newState;
+    if (out->enabled) {
+      annOutputSetLevel(out, out->state);
+    };
+  };
+}
+
+static void annOutputEnabled(annunciator_output_t* out, bool newEnabled)
+{
+  if (out->enabled != newEnabled) {
+    out->enabled = newEnabled;
+    annOutputSetLevel(out, newEnabled ? out->state : false);
+  };
+}
+
+static void annOutputOn(annunciator_output_t* out, bool fixed)
+{
+  if (fixed) out->onCount++;
+  out->on = true;
+  if (!out->blinkPriority) {
+    out->flash = false;
+    out->blink = false;
+  };
+  out->wait = portMAX_DELAY;
+  annOutputSetState(out, true);
+}
+
+static void annOutputOff(annunciator_output_t* out, bool fixed)
+{
+  if (fixed && (out->onCount > 0)) out->onCount--;
+  if (out->onCount == 0) {
+    out->on = false;
+    if (out->blinkPriority) {
+      if (out->flash && (out->flashInterval > 0)) {
+        out->wait = pdMS_TO_TICKS(out->flashInterval);
+      } else if (out->blink && (out->blinkInterval > 0)) {
+        out->wait = pdMS_TO_TICKS(out->blinkInterval);
+        out->blinkCount = 0;
+      } else {
+        out->wait = portMAX_DELAY;
+      };
+    } else {
+      out->flash = false;
+      out->blink = false;
+      out->wait = portMAX_DELAY;
+    };
+    annOutputSetState(out, false);
+  };
+}
+
+static void annOutputFlashOn(annunciator_output_t* out, uint16_t quantity, uint16_t duration, uint16_t interval)
+{
+  out->flash = true;
+  out->flashDuration = duration;
+  out->flashQuantity = quantity;
+  out->flashInterval = interval;
+  out->flashCount = 0;
+  if (!out->blinkPriority) {
+    out->on = false;
+    out->blink = false;
+  };
+  if (out->onCount == 0) {
+    out->on = false;
+    out->wait = 0;
+    annOutputSetState(out, false);
+  };
+}
+
+static void annOutputFlashOff(annunciator_output_t* out)
+{
+  if (out->flash) {
+    out->flash = false;
+    if (out->onCount == 0) {
+      out->on = false;
+      if (out->blinkPriority && out->blink) {
+        out->wait = pdMS_TO_TICKS(out->blinkInterval);
+        out->blinkCount = 0;
+      } else {
+        out->blink = false;
+        out->wait = portMAX_DELAY;
+      };
+      annOutputSetState(out, false);
+    };
+  };
+}
+
+static void annOutputBlinkOn(annunciator_output_t* out, uint16_t quantity, uint16_t duration, uint16_t interval)
+{
+  out->blink = true;
+  out->blinkDuration = duration;
+  out->blinkQuantity = quantity;
+  out->blinkInterval = interval;
+  out->blinkCount = 0;
+  if ((out->onCount == 0) && !out->flash) {
+    out->on = false;
+    out->wait = 0;
+    annOutputSetState(out, false);
+  };
+}
+
+static void annOutputBlinkOff(annunciator_output_t* out)
+{
+  if (out->blink) {
+    out->blink = false;
+    out->flash = false;
+    if (out->onCount == 0) {
+      out->on = false;
+      annOutputSetState(out, false);
+    };
+    out->wait = portMAX_DELAY;
+  };
+}
+
+static void annOutputProcessTimeout(annunciator_output_t* out)
+{
+  if (out->flash) {
+    if (out->state) {
+      if (++out->flashCount >= out->flashQuantity) {
+        out->flashCount = 0;
+        annOutputFlashOff(out);
+      } else {
+        out->wait = pdMS_TO_TICKS(out->flashInterval);
+        annOutputSetState(out, false);
+      };
+    } else {
+      out->wait = pdMS_TO_TICKS(out->flashDuration);
+      annOutputSetState(out, true);
+    };
+  } else if (out->blink) {
+    if (out->state) {
+      if (++out->blinkCount >= out->blinkQuantity) {
+        out->blinkCount = 0;
+        out->wait = pdMS_TO_TICKS(out->blinkInterval);
+      } else {
+        out->wait = pdMS_TO_TICKS(out->blinkDuration);
+      };
+      annOutputSetState(out, false);
+    } else {
+      out->wait = pdMS_TO_TICKS(out->blinkDuration);
+      annOutputSetState(out, true);
+    };
+  };
+}
+
+static void annOutputCommand(annunciator_output_t* out, ledQueueData_t* msg)
+{
+  rlog_v(logTAG, "New command for [ %s ]: %d, %d, %d, %d", out->name, msg->msgMode, msg->msgValue1, msg->msgValue2, msg->msgValue3);
+  switch (msg->msgMode) {
+    case lmEnable:
+      annOutputEnabled(out, (bool)msg->msgValue1);
+      break;
+    case lmOn:
+      annOutputOn(out, (bool)msg->msgValue1);
+      break;
+    case lmOff:
+      annOutputOff(out, (bool)msg->msgValue1);
+      break;
+    case lmFlash:
+      annOutputFlashOn(out, msg->msgValue1, msg->msgValue2, msg->msgValue3);
+      break;
+    case lmBlinkOn:
+      annOutputBlinkOn(out, msg->msgValue1, msg->msgValue2, msg->msgValue3);
+      break;
+    case lmBlinkOff:
+      annOutputBlinkOff(out);
+      break;
+  };
+}
+
+// Перенос относительного таймаута выхода на общую шкалу времени
+static void annOutputSchedule(annunciator_output_t* out, TickType_t now)
+{
+  out->timed = (out->wait != portMAX_DELAY);
+  if (out->timed) {
+    out->next = now + out->wait;
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Задача -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void annunciatorTaskExec(void *pvParameters)
+{
+  ledQueueData_t msg;
+  while (1) {
+    // Ближайшее переключение среди всех выходов
+    TickType_t now = xTaskGetTickCount();
+    TickType_t timeout = portMAX_DELAY;
+    uint8_t count = _outputsCount;
+    for (uint8_t i = 0; i < count; i++) {
+      if (_outputs[i].timed) {
+        TickType_t left = ((int32_t)(_outputs[i].next - now) > 0) ? (_outputs[i].next - now) : 0;
+        if (left < timeout) timeout = left;
+      };
+    };
+
+    // Ожидаем команду для любого из выходов или наступление ближайшего переключения
+    QueueSetMemberHandle_t member = xQueueSelectFromSet(_annunciatorSet, timeout);
+    now = xTaskGetTickCount();
+    count = _outputsCount;
+    if (member) {
+      for (uint8_t i = 0; i < count; i++) {
+        if (_outputs[i].queue == member) {
+          if (xQueueReceive(_outputs[i].queue, &msg, 0) == pdPASS) {
+            annOutputCommand(&_outputs[i], &msg);
+            // Включение сирены после срабатывания зоны завершает измерение пути "зона -> сирена". reAlarm включает 
+            // сирену постоянно (lmOn) только по тревоге, короткие сигналы постановки и снятия подаются как lmFlash
+            if (_outputs[i].alarm && (msg.msgMode == lmOn)) {
+              perfMarkRecord(_perfAlarm, 10000000);
+            };
+            // Как и в reLed, сразу после команды выполняется очередной шаг (например, первая вспышка)
+            annOutputProcessTimeout(&_outputs[i]);
+            annOutputSchedule(&_outputs[i], now);
+          };
+          break;
+        };
+      };
+    };
+
+    // Переключаем выходы, для которых наступило время
+    for (uint8_t i = 0; i < count; i++) {
+      if (_outputs[i].timed && ((int32_t)(_outputs[i].next - now) <= 0)) {
+        annOutputProcessTimeout(&_outputs[i]);
+        annOutputSchedule(&_outputs[i], now);
+      };
+    };
+  };
+  vTaskDelete(nullptr);
+}
+
+static bool annunciatorTaskCreate()
+{
+  if (_annunciatorTask == nullptr) {
+    _perfAlarm = perfRegister("zone_to_siren");
+    _annunciatorSet = xQueueCreateSet(CONFIG_ANNUNCIATOR_MAX_OUTPUTS * CONFIG_LED_QUEUE_SIZE);
+    if (_annunciatorSet == nullptr) {
+      rloga_e("Failed to create a queue set for annunciator!");
+      return false;
+    };
+    _annunciatorTask = xTaskCreateStaticPinnedToCore(annunciatorTaskExec, annunciatorTaskName,
+      CONFIG_ANNUNCIATOR_TASK_STACK_SIZE, NULL, CONFIG_TASK_PRIORITY_LED, _annunciatorTaskStack, &_annunciatorTaskBuffer, CONFIG_TASK_CORE_LED);
+    if (_annunciatorTask) {
+      rloga_i("Task [ %s ] has been successfully created and started", annunciatorTaskName);
+    } else {
+      rloga_e("Failed to create a task for annunciator!");
+      return false;
+    };
+  };
+  return true;
+}
+
+ledQueue_t annunciatorAdd(int8_t ledGPIO, bool ledHigh, bool blinkPriority, const char* ledName, ledCustomControl_t customControl)
+{
+  if (_outputsCount >= CONFIG_ANNUNCIATOR_MAX_OUTPUTS) {
+    rlog_e(logTAG, "Failed to add output [ %s ]: too many outputs", ledName);
+    return nullptr;
+  };
+  if (!annunciatorTaskCreate()) return nullptr;
+
+  annunciator_output_t* out = &_outputs[_outputsCount];
+  memset(out, 0, sizeof(annunciator_output_t));
+  out->name = ledName;
+  out->gpio = ledGPIO;
+  out->high = ledHigh;
+  out->blinkPriority = blinkPriority;
+  out->customControl = customControl;
+  out->enabled = true;
+  out->wait = portMAX_DELAY;
+
+  out->queue = xQueueCreateStatic(CONFIG_LED_QUEUE_SIZE, sizeof(ledQueueData_t), out->queueStorage, &out->queueBuffer);
+  if ((out->queue == nullptr) || (xQueueAddToSet(out->queue, _annunciatorSet) != pdPASS)) {
+    rlog_e(logTAG, "Failed to create a queue for output [ %s ]", ledName);
+    return nullptr;
+  };
+
+  // Инициализация GPIO и выключение выхода
+  if ((ledGPIO > -1) && (customControl == nullptr)) {
+    gpio_reset_pin((gpio_num_t)ledGPIO);
+    gpio_set_direction((gpio_num_t)ledGPIO, GPIO_MODE_OUTPUT);
+    gpio_set_pull_mode((gpio_num_t)ledGPIO, GPIO_FLOATING);
+  };
+  annOutputSetLevel(out, false);
+
+  // Выход становится видимым для задачи только после полной инициализации
+  _outputsCount = _outputsCount + 1;
+  rlog_i(logTAG, "Output [ %s ] on GPIO %d added to annunciator", ledName, ledGPIO);
+  return out->queue;
+}
+
+void annunciatorSetAlarmOutput(ledQueue_t output)
+{
+  uint8_t count = _outputsCount;
+  for (uint8_t i = 0; i < count; i++) {
+    if (_outputs[i].queue == output) {
+      _outputs[i].alarm = true;
+      break;
+    };
+  };
+}
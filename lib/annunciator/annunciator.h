@@ -0,0 +1,46 @@
+/*
+   Модуль управления светодиодами, сиренами и пищалками из одной задачи.
+   Каждый выход получает собственную очередь ledQueue_t, совместимую с ledTaskSend() / ledTaskSendFromISR(),
+   но все очереди обслуживаются одной задачей через набор очередей (queue set) и общий планировщик таймаутов
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __ANNUNCIATOR_H__
+#define __ANNUNCIATOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "reLed.h"
+#include "project_config.h"
+
+// Максимальное количество выходов
+#ifndef CONFIG_ANNUNCIATOR_MAX_OUTPUTS
+#define CONFIG_ANNUNCIATOR_MAX_OUTPUTS 6
+#endif // CONFIG_ANNUNCIATOR_MAX_OUTPUTS
+
+#ifndef CONFIG_ANNUNCIATOR_TASK_STACK_SIZE
+#define CONFIG_ANNUNCIATOR_TASK_STACK_SIZE 2*1024
+#endif // CONFIG_ANNUNCIATOR_TASK_STACK_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Добавление выхода. Параметры аналогичны ledTaskCreate(), но отдельная задача не создается.
+ * Возвращаемую очередь нельзя удалять с помощью ledTaskDelete()
+ * */
+ledQueue_t annunciatorAdd(int8_t ledGPIO, bool ledHigh, bool blinkPriority, const char* ledName, ledCustomControl_t customControl);
+
+/**
+ * Отметить выход как сирену: только его включение учитывается в метрике "zone_to_siren"
+ * */
+void annunciatorSetAlarmOutput(ledQueue_t output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ANNUNCIATOR_H__
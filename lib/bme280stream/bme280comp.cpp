@@ -0,0 +1,40 @@
+#include "bme280comp.h"
+
+int32_t bme280CompensateTemperature(const bme280s_calib_t* calib, const int32_t adc_T, int32_t* t_fine)
+{
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)calib->dig_t1 << 1))) * ((int32_t)calib->dig_t2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)calib->dig_t1)) * ((adc_T >> 4) - ((int32_t)calib->dig_t1))) >> 12) * ((int32_t)calib->dig_t3)) >> 14;
+  *t_fine = var1 + var2;
+  return (*t_fine * 5 + 128) >> 8;
+}
+
+uint32_t bme280CompensatePressure(const bme280s_calib_t* calib, const int32_t adc_P, const int32_t t_fine)
+{
+  int64_t var1 = ((int64_t)t_fine) - 128000;
+  int64_t var2 = var1 * var1 * (int64_t)calib->dig_p6;
+  var2 = var2 + ((var1 * (int64_t)calib->dig_p5) << 17);
+  var2 = var2 + (((int64_t)calib->dig_p4) << 35);
+  var1 = ((var1 * var1 * (int64_t)calib->dig_p3) >> 8) + ((var1 * (int64_t)calib->dig_p2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calib->dig_p1) >> 33;
+  // Защита от деления на ноль
+  if (var1 == 0) return 0;
+  int64_t p = 1048576 - adc_P;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)calib->dig_p9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)calib->dig_p8) * p) >> 19;
+  p = ((p + var1 + var2) >> 8) + (((int64_t)calib->dig_p7) << 4);
+  return (uint32_t)p;
+}
+
+uint32_t bme280CompensateHumidity(const bme280s_calib_t* calib, const int32_t adc_H, const int32_t t_fine)
+{
+  int32_t v_x1_u32r = (t_fine - ((int32_t)76800));
+  v_x1_u32r = (((((adc_H << 14) - (((int32_t)calib->dig_h4) << 20) - (((int32_t)calib->dig_h5) * v_x1_u32r)) +
+    ((int32_t)16384)) >> 15) * (((((((v_x1_u32r * ((int32_t)calib->dig_h6)) >> 10) * (((v_x1_u32r *
+    ((int32_t)calib->dig_h3)) >> 11) + ((int32_t)32768))) >> 10) + ((int32_t)2097152)) *
+    ((int32_t)calib->dig_h2) + 8192) >> 14));
+  v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int32_t)calib->dig_h1)) >> 4));
+  v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
+  v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
+  return (uint32_t)(v_x1_u32r >> 12);
+}
@@ -0,0 +1,60 @@
+/*
+   Целочисленная компенсация показаний BME280 по алгоритмам Bosch (BME280 datasheet, раздел 4.2.3):
+   32 бита для температуры и влажности, 64 бита для давления. Модуль не зависит от ESP-IDF и проверяется
+   на хосте тестом test/test_bme280comp.cpp (каталог test не собирается PlatformIO в составе библиотеки)
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __BME280COMP_H__
+#define __BME280COMP_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Калибровочные коэффициенты из NVM датчика
+typedef struct {
+  uint16_t dig_t1;
+  int16_t  dig_t2;
+  int16_t  dig_t3;
+  uint16_t dig_p1;
+  int16_t  dig_p2;
+  int16_t  dig_p3;
+  int16_t  dig_p4;
+  int16_t  dig_p5;
+  int16_t  dig_p6;
+  int16_t  dig_p7;
+  int16_t  dig_p8;
+  int16_t  dig_p9;
+  uint8_t  dig_h1;
+  int16_t  dig_h2;
+  uint8_t  dig_h3;
+  int16_t  dig_h4;
+  int16_t  dig_h5;
+  int8_t   dig_h6;
+} bme280s_calib_t;
+
+/**
+ * Температура в 0.01 °C, t_fine - промежуточное значение для компенсации давления и влажности
+ * */
+int32_t  bme280CompensateTemperature(const bme280s_calib_t* calib, const int32_t adc_T, int32_t* t_fine);
+
+/**
+ * Давление в Па в формате Q24.8 (0 - ошибка калибровки)
+ * */
+uint32_t bme280CompensatePressure(const bme280s_calib_t* calib, const int32_t adc_P, const int32_t t_fine);
+
+/**
+ * Относительная влажность в % в формате Q22.10
+ * */
+uint32_t bme280CompensateHumidity(const bme280s_calib_t* calib, const int32_t adc_H, const int32_t t_fine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __BME280COMP_H__
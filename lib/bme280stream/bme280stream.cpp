@@ -0,0 +1,297 @@
+#include "bme280stream.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rLog.h"
+#include "rStrings.h"
+#include "def_consts.h"
+#include "i2cbatch.h"
+
+static const char* logTAG = "BME280";
+
+#define BME280S_I2C_TIMEOUT       3000
+
+#define BME280S_REG_CHIP_ID       0xD0
+#define BME280S_REG_RESET         0xE0
+#define BME280S_REG_CALIB_TP      0x88
+#define BME280S_REG_CALIB_H       0xE1
+#define BME280S_REG_CTRL_HUM      0xF2
+#define BME280S_REG_STATUS        0xF3
+#define BME280S_REG_CTRL_MEAS     0xF4
+#define BME280S_REG_CONFIG        0xF5
+#define BME280S_REG_DATA          0xF7
+
+#define BME280S_CHIP_ID           0x60
+#define BME280S_SOFT_RESET        0xB6
+#define BME280S_STATUS_IM_UPDATE  0x01
+#define BME280S_CALIB_TP_LEN      26
+#define BME280S_CALIB_H_LEN       7
+#define BME280S_DATA_LEN          8
+
+// Значения АЦП, которые датчик выдает для отключенных или еще не выполненных измерений
+#define BME280S_SKIPPED_TP        0x80000
+#define BME280S_SKIPPED_H         0x8000
+
+BME280Stream::BME280Stream(uint8_t eventId):rSensorX3(eventId)
+{
+  memset(&_calib, 0, sizeof(_calib));
+}
+
+bool BME280Stream::initStream(const char* sensorName, const char* topicName, const bool topicLocal,
+  const i2c_port_t numI2C, const uint8_t addrI2C,
+  BME280_STANDBYTIME odr, BME280_IIR_FILTER filter,
+  BME280_OVERSAMPLING osPress, BME280_OVERSAMPLING osTemp, BME280_OVERSAMPLING osHumd,
+  rSensorItem* item1, rSensorItem* item2, rSensorItem* item3,
+  const uint32_t minReadInterval, const uint16_t errorLimit,
+  cb_status_changed_t cb_status, cb_publish_data_t cb_publish)
+{
+  _I2C_num = numI2C;
+  _I2C_address = addrI2C;
+  _odr = odr;
+  _filter = filter;
+  _osPress = osPress;
+  _osTemp = osTemp;
+  _osHumd = osHumd;
+  // Initialize properties
+  initProperties(sensorName, topicName, topicLocal, minReadInterval, errorLimit, cb_status, cb_publish);
+  // Assign items
+  this->rSensorX3::setSensorItems(item1, item2, item3);
+  // Start device
+  return sensorStart();
+}
+
+void BME280Stream::createSensorItems(const sensor_filter_t filterMode1, const uint16_t filterSize1,
+                                     const sensor_filter_t filterMode2, const uint16_t filterSize2,
+                                     const sensor_filter_t filterMode3, const uint16_t filterSize3)
+{
+  // Pressure
+  _item1 = new rPressureItem(this, CONFIG_SENSOR_PRESSURE_NAME, CONFIG_FORMAT_PRESSURE_UNIT,
+    filterMode1, filterSize1,
+    CONFIG_FORMAT_PRESSURE_VALUE, CONFIG_FORMAT_PRESSURE_STRING,
+    #if CONFIG_SENSOR_TIMESTAMP_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_L,
+    #endif // CONFIG_SENSOR_TIMESTAMP_ENABLE
+    #if CONFIG_SENSOR_TIMESTRING_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_S, CONFIG_FORMAT_TSVALUE
+    #endif // CONFIG_SENSOR_TIMESTRING_ENABLE
+  );
+  if (_item1) {
+    rlog_d(_name, RSENSOR_LOG_MSG_CREATE_ITEM, _item1->getName(), _name);
+  };
+
+  // Temperature
+  _item2 = new rTemperatureItem(this, CONFIG_SENSOR_TEMP_NAME, CONFIG_FORMAT_TEMP_UNIT,
+    filterMode2, filterSize2,
+    CONFIG_FORMAT_TEMP_VALUE, CONFIG_FORMAT_TEMP_STRING,
+    #if CONFIG_SENSOR_TIMESTAMP_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_L,
+    #endif // CONFIG_SENSOR_TIMESTAMP_ENABLE
+    #if CONFIG_SENSOR_TIMESTRING_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_S, CONFIG_FORMAT_TSVALUE
+    #endif // CONFIG_SENSOR_TIMESTRING_ENABLE
+  );
+  if (_item2) {
+    rlog_d(_name, RSENSOR_LOG_MSG_CREATE_ITEM, _item2->getName(), _name);
+  };
+
+  // Humidity
+  _item3 = new rSensorItem(this, CONFIG_SENSOR_HUMIDITY_NAME,
+    filterMode3, filterSize3,
+    CONFIG_FORMAT_HUMIDITY_VALUE, CONFIG_FORMAT_HUMIDITY_STRING,
+    #if CONFIG_SENSOR_TIMESTAMP_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_L,
+    #endif // CONFIG_SENSOR_TIMESTAMP_ENABLE
+    #if CONFIG_SENSOR_TIMESTRING_ENABLE
+    CONFIG_FORMAT_TIMESTAMP_S, CONFIG_FORMAT_TSVALUE
+    #endif // CONFIG_SENSOR_TIMESTRING_ENABLE
+  );
+  if (_item3) {
+    rlog_d(_name, RSENSOR_LOG_MSG_CREATE_ITEM, _item3->getName(), _name);
+  };
+}
+
+void BME280Stream::registerItemsParameters(paramsGroupHandle_t parent_group)
+{
+  // Pressure
+  if (_item1) {
+    _item1->registerParameters(parent_group, CONFIG_SENSOR_PRESSURE_KEY, CONFIG_SENSOR_PRESSURE_NAME, CONFIG_SENSOR_PRESSURE_FRIENDLY);
+  };
+  // Temperature
+  if (_item2) {
+    _item2->registerParameters(parent_group, CONFIG_SENSOR_TEMP_KEY, CONFIG_SENSOR_TEMP_NAME, CONFIG_SENSOR_TEMP_FRIENDLY);
+  };
+  // Humidity
+  if (_item3) {
+    _item3->registerParameters(parent_group, CONFIG_SENSOR_HUMIDITY_KEY, CONFIG_SENSOR_HUMIDITY_NAME, CONFIG_SENSOR_HUMIDITY_FRIENDLY);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Устройство -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+sensor_status_t BME280Stream::sensorReset()
+{
+  i2c_batch_t batch;
+  uint8_t reg;
+  uint8_t value;
+
+  // Программный сброс
+  reg = BME280S_REG_RESET;
+  value = BME280S_SOFT_RESET;
+  i2cBatchInit(&batch, _I2C_num, BME280S_I2C_TIMEOUT);
+  i2cBatchAddWrite(&batch, _I2C_address, &reg, 1, &value, 1);
+  if (i2cBatchExec(&batch) != ESP_OK) return SENSOR_STATUS_CONN_ERROR;
+
+  // Ожидание копирования NVM в регистры (не более 2 мс по документации)
+  uint8_t status = BME280S_STATUS_IM_UPDATE;
+  for (uint8_t i = 0; (i < 5) && (status & BME280S_STATUS_IM_UPDATE); i++) {
+    vTaskDelay(pdMS_TO_TICKS(2));
+    reg = BME280S_REG_STATUS;
+    i2cBatchInit(&batch, _I2C_num, BME280S_I2C_TIMEOUT);
+    i2cBatchAddRead(&batch, _I2C_address, &reg, 1, &status, 1, 0);
+    if (i2cBatchExec(&batch) != ESP_OK) return SENSOR_STATUS_CONN_ERROR;
+  };
+  if (status & BME280S_STATUS_IM_UPDATE) {
+    rlog_e(logTAG, "%s: NVM data copying is not completed", _name);
+    return SENSOR_STATUS_CAL_ERROR;
+  };
+
+  // Идентификатор и калибровочные коэффициенты - за один захват шины
+  uint8_t chip_id = 0;
+  uint8_t calib_tp[BME280S_CALIB_TP_LEN];
+  uint8_t calib_h[BME280S_CALIB_H_LEN];
+  uint8_t reg_id = BME280S_REG_CHIP_ID;
+  uint8_t reg_tp = BME280S_REG_CALIB_TP;
+  uint8_t reg_h = BME280S_REG_CALIB_H;
+  i2cBatchInit(&batch, _I2C_num, BME280S_I2C_TIMEOUT);
+  i2cBatchAddRead(&batch, _I2C_address, &reg_id, 1, &chip_id, 1, 0);
+  i2cBatchAddRead(&batch, _I2C_address, &reg_tp, 1, calib_tp, sizeof(calib_tp), 0);
+  i2cBatchAddRead(&batch, _I2C_address, &reg_h, 1, calib_h, sizeof(calib_h), 0);
+  if (i2cBatchExec(&batch) != ESP_OK) return SENSOR_STATUS_CONN_ERROR;
+  if (chip_id != BME280S_CHIP_ID) {
+    rlog_e(logTAG, "%s: invalid chip id 0x%.2X", _name, chip_id);
+    return SENSOR_STATUS_CONN_ERROR;
+  };
+
+  _calib.dig_t1 = (uint16_t)((calib_tp[1] << 8) | calib_tp[0]);
+  _calib.dig_t2 = (int16_t)((calib_tp[3] << 8) | calib_tp[2]);
+  _calib.dig_t3 = (int16_t)((calib_tp[5] << 8) | calib_tp[4]);
+  _calib.dig_p1 = (uint16_t)((calib_tp[7] << 8) | calib_tp[6]);
+  _calib.dig_p2 = (int16_t)((calib_tp[9] << 8) | calib_tp[8]);
+  _calib.dig_p3 = (int16_t)((calib_tp[11] << 8) | calib_tp[10]);
+  _calib.dig_p4 = (int16_t)((calib_tp[13] << 8) | calib_tp[12]);
+  _calib.dig_p5 = (int16_t)((calib_tp[15] << 8) | calib_tp[14]);
+  _calib.dig_p6 = (int16_t)((calib_tp[17] << 8) | calib_tp[16]);
+  _calib.dig_p7 = (int16_t)((calib_tp[19] << 8) | calib_tp[18]);
+  _calib.dig_p8 = (int16_t)((calib_tp[21] << 8) | calib_tp[20]);
+  _calib.dig_p9 = (int16_t)((calib_tp[23] << 8) | calib_tp[22]);
+  _calib.dig_h1 = calib_tp[25];
+  _calib.dig_h2 = (int16_t)((calib_h[1] << 8) | calib_h[0]);
+  _calib.dig_h3 = calib_h[2];
+  _calib.dig_h4 = (int16_t)((int16_t)(int8_t)calib_h[3] * 16) | (int16_t)(calib_h[4] & 0x0F);
+  _calib.dig_h5 = (int16_t)((int16_t)(int8_t)calib_h[5] * 16) | (int16_t)(calib_h[4] >> 4);
+  _calib.dig_h6 = (int8_t)calib_h[6];
+
+  // Настройки: ctrl_hum вступает в силу только после записи ctrl_meas, поэтому он пишется первым
+  uint8_t reg_hum = BME280S_REG_CTRL_HUM;
+  uint8_t reg_cfg = BME280S_REG_CONFIG;
+  uint8_t reg_meas = BME280S_REG_CTRL_MEAS;
+  uint8_t ctrl_hum = (uint8_t)_osHumd & 0x07;
+  uint8_t config = (((uint8_t)_odr & 0x07) << 5) | (((uint8_t)_filter & 0x07) << 2);
+  uint8_t ctrl_meas = (((uint8_t)_osTemp & 0x07) << 5) | (((uint8_t)_osPress & 0x07) << 2) | ((uint8_t)BME280_MODE_NORMAL & 0x03);
+  i2cBatchInit(&batch, _I2C_num, BME280S_I2C_TIMEOUT);
+  i2cBatchAddWrite(&batch, _I2C_address, &reg_hum, 1, &ctrl_hum, 1);
+  i2cBatchAddWrite(&batch, _I2C_address, &reg_cfg, 1, &config, 1);
+  i2cBatchAddWrite(&batch, _I2C_address, &reg_meas, 1, &ctrl_meas, 1);
+  if (i2cBatchExec(&batch) != ESP_OK) return SENSOR_STATUS_CONN_ERROR;
+
+  rlog_i(logTAG, "%s: normal mode started (standby %d, filter %d, osr %d/%d/%d)", _name, _odr, _filter, _osPress, _osTemp, _osHumd);
+  return SENSOR_STATUS_OK;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Чтение --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+sensor_status_t BME280Stream::readRawData()
+{
+  // В режиме NORMAL датчик измеряет сам, достаточно одного пакетного чтения последних значений
+  uint8_t reg = BME280S_REG_DATA;
+  uint8_t data[BME280S_DATA_LEN];
+  i2c_batch_t batch;
+  i2cBatchInit(&batch, _I2C_num, BME280S_I2C_TIMEOUT);
+  i2cBatchAddRead(&batch, _I2C_address, &reg, 1, data, sizeof(data), 0);
+  if (i2cBatchExec(&batch) != ESP_OK) return SENSOR_STATUS_CONN_ERROR;
+
+  int32_t adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | ((int32_t)data[2] >> 4);
+  int32_t adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | ((int32_t)data[5] >> 4);
+  int32_t adc_H = ((int32_t)data[6] << 8) | (int32_t)data[7];
+  if ((adc_T == BME280S_SKIPPED_TP) || (adc_P == BME280S_SKIPPED_TP) || (adc_H == BME280S_SKIPPED_H)) {
+    return SENSOR_STATUS_NO_DATA;
+  };
+
+  int32_t t_fine;
+  int32_t temperature = bme280CompensateTemperature(&_calib, adc_T, &t_fine);
+  uint32_t pressure = bme280CompensatePressure(&_calib, adc_P, t_fine);
+  uint32_t humidity = bme280CompensateHumidity(&_calib, adc_H, t_fine);
+  if (pressure == 0) return SENSOR_STATUS_CAL_ERROR;
+
+  // Перевод в value_t только на границе с rSensorItem
+  return setRawValues((value_t)pressure / 256.0f, (value_t)temperature / 100.0f, (value_t)humidity / 1024.0f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Публикация -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_SENSOR_DISPLAY_ENABLED
+
+char* BME280Stream::getDisplayValue()
+{
+  char* ret = nullptr;
+  if (_item2) {
+    ret = _item2->getStringFiltered();
+  };
+  if (_item3) {
+    ret = concat_strings_div(ret, _item3->getStringFiltered(), CONFIG_JSON_CHAR_EOL);
+  };
+  return ret;
+}
+
+#endif // CONFIG_SENSOR_DISPLAY_ENABLED
+
+#if CONFIG_SENSOR_AS_PLAIN
+
+bool BME280Stream::publishCustomValues()
+{
+  bool ret = rSensor::publishCustomValues();
+
+  #if CONFIG_SENSOR_DEWPOINT_ENABLE
+    if ((ret) && (_item2) && (_item3)) {
+      ret = _item2->publishDataValue(CONFIG_SENSOR_DEWPOINT,
+        calcDewPoint(_item2->getValue().filteredValue, _item3->getValue().filteredValue));
+    };
+  #endif // CONFIG_SENSOR_DEWPOINT_ENABLE
+
+  return ret;
+}
+
+#endif // CONFIG_SENSOR_AS_PLAIN
+
+#if CONFIG_SENSOR_AS_JSON
+
+char* BME280Stream::jsonCustomValues()
+{
+  #if CONFIG_SENSOR_DEWPOINT_ENABLE
+    if ((_item2) && (_item3)) {
+      char * _dew_point = _item2->jsonDataValue(true, calcDewPoint(_item2->getValue().filteredValue, _item3->getValue().filteredValue));
+      char * ret = malloc_stringf("\"%s\":%s", CONFIG_SENSOR_DEWPOINT, _dew_point);
+      if (_dew_point) free(_dew_point);
+      return ret;
+    };
+  #endif // CONFIG_SENSOR_DEWPOINT_ENABLE
+  return nullptr;
+}
+
+#endif // CONFIG_SENSOR_AS_JSON
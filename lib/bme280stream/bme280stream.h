@@ -0,0 +1,69 @@
+/*
+   Модуль датчика BME280 в непрерывном (NORMAL) режиме: датчик сам выполняет измерения с заданным периодом
+   и сглаживает давление и температуру встроенным IIR-фильтром, чтение данных - одна пакетная транзакция I2C.
+   Компенсация выполняется целочисленными алгоритмами Bosch (32 бита для температуры и влажности,
+   64 бита для давления), в формат с плавающей точкой значения переводятся только при передаче в rSensorItem
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __BME280STREAM_H__
+#define __BME280STREAM_H__
+
+#include <stdint.h>
+#include "driver/i2c.h"
+#include "reSensor.h"
+#include "reBME280.h"
+#include "bme280comp.h"
+
+class BME280Stream : public rSensorX3 {
+  public:
+    BME280Stream(uint8_t eventId);
+
+    // Подключение статически созданных элементов и запуск датчика в режиме NORMAL
+    bool initStream(const char* sensorName, const char* topicName, const bool topicLocal,
+      // hardware properties
+      const i2c_port_t numI2C, const uint8_t addrI2C,
+      BME280_STANDBYTIME odr, BME280_IIR_FILTER filter,
+      BME280_OVERSAMPLING osPress, BME280_OVERSAMPLING osTemp, BME280_OVERSAMPLING osHumd,
+      // items
+      rSensorItem* item1, rSensorItem* item2, rSensorItem* item3,
+      // limits
+      const uint32_t minReadInterval, const uint16_t errorLimit,
+      // callbacks
+      cb_status_changed_t cb_status = nullptr, cb_publish_data_t cb_publish = nullptr);
+
+    // Программный сброс, чтение калибровки и запуск режима NORMAL (в том числе при восстановлении после ошибок)
+    sensor_status_t sensorReset() override;
+  protected:
+    void createSensorItems(
+      // pressure value
+      const sensor_filter_t filterMode1, const uint16_t filterSize1,
+      // temperature value
+      const sensor_filter_t filterMode2, const uint16_t filterSize2,
+      // humidity value
+      const sensor_filter_t filterMode3, const uint16_t filterSize3) override;
+    void registerItemsParameters(paramsGroupHandle_t parent_group) override;
+    sensor_status_t readRawData() override;
+    #if CONFIG_SENSOR_DISPLAY_ENABLED
+    char* getDisplayValue() override;
+    #endif // CONFIG_SENSOR_DISPLAY_ENABLED
+    #if CONFIG_SENSOR_AS_PLAIN
+    bool publishCustomValues() override;
+    #endif // CONFIG_SENSOR_AS_PLAIN
+    #if CONFIG_SENSOR_AS_JSON
+    char* jsonCustomValues() override;
+    #endif // CONFIG_SENSOR_AS_JSON
+  private:
+    i2c_port_t          _I2C_num = I2C_NUM_0;
+    uint8_t             _I2C_address = BME280_ADDRESS_0X76;
+    BME280_STANDBYTIME  _odr = BME280_STANDBY_1000ms;
+    BME280_IIR_FILTER   _filter = BME280_FLT_NONE;
+    BME280_OVERSAMPLING _osPress = BME280_OSM_X1;
+    BME280_OVERSAMPLING _osTemp = BME280_OSM_X1;
+    BME280_OVERSAMPLING _osHumd = BME280_OSM_X1;
+    bme280s_calib_t     _calib;
+};
+
+#endif // __BME280STREAM_H__
@@ -0,0 +1,87 @@
+/*
+   Проверка целочисленной компенсации BME280 на хосте по контрольным значениям из документации Bosch
+   (калибровочные коэффициенты и показания АЦП из примера расчета в datasheet BMP280 / BME280).
+   Сборка и запуск из корня проекта:
+   g++ -std=gnu++17 -Wall -Ilib/bme280stream lib/bme280stream/bme280comp.cpp lib/bme280stream/test/test_bme280comp.cpp -o /tmp/test_bme280comp && /tmp/test_bme280comp
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "bme280comp.h"
+
+static int _failed = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); _failed++; }; } while (0)
+
+static void testDatasheetVectors()
+{
+  bme280s_calib_t calib;
+  memset(&calib, 0, sizeof(calib));
+  calib.dig_t1 = 27504;
+  calib.dig_t2 = 26435;
+  calib.dig_t3 = -1000;
+  calib.dig_p1 = 36477;
+  calib.dig_p2 = -10685;
+  calib.dig_p3 = 3024;
+  calib.dig_p4 = 2855;
+  calib.dig_p5 = 140;
+  calib.dig_p6 = -7;
+  calib.dig_p7 = 15500;
+  calib.dig_p8 = -14600;
+  calib.dig_p9 = 6000;
+
+  // adc_T = 519888 -> 25.08 °C, t_fine = 128422
+  int32_t t_fine = 0;
+  int32_t temperature = bme280CompensateTemperature(&calib, 519888, &t_fine);
+  CHECK(temperature == 2508);
+  CHECK(t_fine == 128422);
+
+  // adc_P = 415148 -> 100653.27 Па (значение в документации получено расчетом с плавающей точкой,
+  // целочисленный алгоритм должен совпасть с ним с точностью до шага Q24.8 в пределах 0.05 Па)
+  uint32_t pressure = bme280CompensatePressure(&calib, 415148, t_fine);
+  CHECK(pressure / 256 == 100653);
+  CHECK((pressure >= 25767237 - 13) && (pressure <= 25767237 + 13));
+
+  // Нулевой dig_p1 - ошибка калибровки, а не деление на ноль
+  calib.dig_p1 = 0;
+  CHECK(bme280CompensatePressure(&calib, 415148, t_fine) == 0);
+}
+
+static void testHumidityRange()
+{
+  // Типичные коэффициенты влажности (контрольного примера в документации нет): проверяются границы и монотонность
+  bme280s_calib_t calib;
+  memset(&calib, 0, sizeof(calib));
+  calib.dig_h1 = 75;
+  calib.dig_h2 = 362;
+  calib.dig_h3 = 0;
+  calib.dig_h4 = 313;
+  calib.dig_h5 = 50;
+  calib.dig_h6 = 30;
+
+  const int32_t t_fine = 128422;
+  CHECK(bme280CompensateHumidity(&calib, 0, t_fine) == 0);
+  CHECK(bme280CompensateHumidity(&calib, 0xFFFF, t_fine) == 100 * 1024);
+  uint32_t prev = 0;
+  for (int32_t adc_H = 0; adc_H <= 0xFFFF; adc_H += 256) {
+    uint32_t humidity = bme280CompensateHumidity(&calib, adc_H, t_fine);
+    CHECK(humidity >= prev);
+    CHECK(humidity <= 100 * 1024);
+    prev = humidity;
+  };
+}
+
+int main()
+{
+  testDatasheetVectors();
+  testHumidityRange();
+  if (_failed > 0) {
+    printf("%d check(s) failed\n", _failed);
+    return 1;
+  };
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include "deadband.h"
+#include <math.h>
+
+void deadbandInit(deadband_item_t* item, const char* key, const char* friendly, float delta, float slope, float fast_slope)
+{
+  item->key = key;
+  item->friendly = friendly;
+  item->delta = delta;
+  item->slope = slope;
+  item->fast_slope = fast_slope;
+  item->value = NAN;
+  item->rate = 0.0;
+  item->time = 0;
+}
+
+void deadbandUpdate(deadband_item_t* item, float value, int64_t now)
+{
+  if (!isnan(item->value) && !isnan(value) && (now > item->time)) {
+    item->rate = fabsf(value - item->value) * 60000000.0 / (float)(now - item->time);
+  } else {
+    item->rate = 0.0;
+  };
+  item->value = value;
+  item->time = now;
+}
+
+bool deadbandIsFast(const deadband_item_t* item)
+{
+  return (item->fast_slope > 0.0) && (item->rate >= item->fast_slope);
+}
+
+static bool deadbandItemChanged(const deadband_item_t* item, float sent)
+{
+  if (isnan(sent) != isnan(item->value)) return true;
+  if (isnan(item->value)) return false;
+  return ((item->delta > 0.0) && (fabsf(item->value - sent) >= item->delta))
+      || ((item->slope > 0.0) && (item->rate >= item->slope));
+}
+
+bool deadbandReportCheck(deadband_report_t* report, deadband_item_t* const* items, uint8_t count,
+  int64_t now, uint32_t heartbeat_s, uint32_t holdoff_s)
+{
+  if (count > CONFIG_DEADBAND_REPORT_ITEMS) count = CONFIG_DEADBAND_REPORT_ITEMS;
+
+  bool send = (report->time == 0) || ((now - report->time) >= (int64_t)heartbeat_s * 1000000);
+  if (!send && ((now - report->time) >= (int64_t)holdoff_s * 1000000)) {
+    for (uint8_t i = 0; i < count; i++) {
+      if (deadbandItemChanged(items[i], report->values[i])) {
+        send = true;
+        break;
+      };
+    };
+  };
+
+  if (send) {
+    for (uint8_t i = 0; i < count; i++) {
+      report->values[i] = items[i]->value;
+    };
+    report->time = now;
+  };
+  return send;
+}
+
+void deadbandReportReset(deadband_report_t* report)
+{
+  report->time = 0;
+}
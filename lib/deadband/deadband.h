@@ -0,0 +1,82 @@
+/*
+   Модуль публикации по изменению (report-by-exception) для отдельных величин сенсоров (rSensorItem).
+   Для каждой величины задаются:
+   - delta: порог отклонения от последнего отправленного значения;
+   - slope: порог скорости изменения, единиц в минуту - при его превышении данные отправляются, даже если
+     отклонение от отправленного значения еще не достигло delta;
+   - fast_slope: порог скорости изменения, при котором задача сенсоров переходит на частый опрос.
+   Нулевой порог не проверяется. Скорость считается между двумя последними показаниями.
+
+   Каждый получатель данных (MQTT, облачные сервисы) хранит свой отчет deadband_report_t с отправленными значениями
+   группы величин: группа отправляется целиком, если изменилась хотя бы одна величина, но не чаще holdoff
+   и не реже heartbeat секунд
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __DEADBAND_H__
+#define __DEADBAND_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "project_config.h"
+
+// Максимальное количество величин в одном отчете
+#ifndef CONFIG_DEADBAND_REPORT_ITEMS
+#define CONFIG_DEADBAND_REPORT_ITEMS 5
+#endif // CONFIG_DEADBAND_REPORT_ITEMS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  // Настройки (изменяются из задачи параметров, запись float атомарна)
+  const char* key;
+  const char* friendly;
+  float delta;              // Порог отклонения, единиц
+  float slope;              // Порог скорости для немедленной отправки, единиц в минуту
+  float fast_slope;         // Порог скорости для частого опроса, единиц в минуту
+  // Состояние (только задача сенсоров)
+  float value;              // Последнее показание
+  float rate;               // Скорость изменения между двумя последними показаниями, единиц в минуту
+  int64_t time;             // Время последнего показания, мкс
+} deadband_item_t;
+
+typedef struct {
+  int64_t time;             // Время последней отправки, мкс (0 - отправить при первой возможности)
+  float values[CONFIG_DEADBAND_REPORT_ITEMS];
+} deadband_report_t;
+
+/**
+ * Инициализация величины (key и friendly должны быть статическими строками)
+ * */
+void deadbandInit(deadband_item_t* item, const char* key, const char* friendly, float delta, float slope, float fast_slope);
+
+/**
+ * Очередное показание (может быть NAN), now - время esp_timer_get_time()
+ * */
+void deadbandUpdate(deadband_item_t* item, float value, int64_t now);
+
+/**
+ * Скорость изменения превысила порог частого опроса
+ * */
+bool deadbandIsFast(const deadband_item_t* item);
+
+/**
+ * Проверка отчета для группы величин items: возвращает true (и запоминает отправленные значения), если группу пора отправить
+ * */
+bool deadbandReportCheck(deadband_report_t* report, deadband_item_t* const* items, uint8_t count,
+  int64_t now, uint32_t heartbeat_s, uint32_t holdoff_s);
+
+/**
+ * Отправить отчет при следующей проверке
+ * */
+void deadbandReportReset(deadband_report_t* report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DEADBAND_H__
@@ -0,0 +1,246 @@
+#include "heatplan.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "rLog.h"
+#include "reEvents.h"
+
+static const char* logTAG = "PLAN";
+
+#define HEATPLAN_DAY_MINUTES    1440
+#define HEATPLAN_WEEK_MINUTES   (7 * HEATPLAN_DAY_MINUTES)
+#define HEATPLAN_POINTS         (CONFIG_HEATPLAN_PERIODS * 14 + 1)
+
+#define HEATPLAN_DAYS_KEY       "days"
+#define HEATPLAN_DAYS_FRIENDLY  "Дни недели"
+#define HEATPLAN_TIME_KEY       "time"
+#define HEATPLAN_TIME_FRIENDLY  "Интервал"
+#define HEATPLAN_TEMP_KEY       "temperature"
+#define HEATPLAN_TEMP_FRIENDLY  "Температура"
+#define HEATPLAN_HYST_KEY       "hysteresis"
+#define HEATPLAN_HYST_FRIENDLY  "Гистерезис"
+#define HEATPLAN_PRE_KEY        "preheat"
+#define HEATPLAN_PRE_FRIENDLY   "Предварительный нагрев"
+
+// Точка переключения: минута недели (0 - полночь с субботы на воскресенье) и период, действующий с этого момента
+typedef struct {
+  uint16_t minute;
+  int8_t period;
+} heat_point_t;
+
+// Значения параметров (изменяются задачей reParams) и их копия, по которой скомпилирована таблица (только задача, вызывающая heatPlanLookup)
+static heat_period_t _periods[CONFIG_HEATPLAN_PERIODS];
+static heat_period_t _plan[CONFIG_HEATPLAN_PERIODS];
+static heat_point_t _points[HEATPLAN_POINTS];
+static uint8_t _pointsCount = 0;
+static bool _planDirty = true;
+static portMUX_TYPE _planMux = portMUX_INITIALIZER_UNLOCKED;
+static char _planKeys[CONFIG_HEATPLAN_PERIODS][4];
+static char _planNames[CONFIG_HEATPLAN_PERIODS][24];
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Таблица -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static bool heatPlanEnabled(heat_period_t* period)
+{
+  return ((period->days & 0x7F) != 0) && (period->time > 0);
+}
+
+// Начало периода в минутах недели для дня day и его длительность в минутах
+static void heatPlanInterval(heat_period_t* period, uint8_t day, uint16_t* start, uint16_t* length)
+{
+  uint16_t begin = period->time / 10000;
+  uint16_t end = period->time % 10000;
+  uint16_t b = (begin / 100) * 60 + (begin % 100);
+  uint16_t e = (end / 100) * 60 + (end % 100);
+  *start = day * HEATPLAN_DAY_MINUTES + b;
+  *length = (b < e) ? (e - b) : (HEATPLAN_DAY_MINUTES - b + e);
+}
+
+static int8_t heatPlanCovers(uint16_t minute)
+{
+  for (uint8_t i = 0; i < CONFIG_HEATPLAN_PERIODS; i++) {
+    if (heatPlanEnabled(&_plan[i])) {
+      for (uint8_t day = 0; day < 7; day++) {
+        if (_plan[i].days & (1U << day)) {
+          uint16_t start, length;
+          heatPlanInterval(&_plan[i], day, &start, &length);
+          if (((minute + HEATPLAN_WEEK_MINUTES - start) % HEATPLAN_WEEK_MINUTES) < length) {
+            return i;
+          };
+        };
+      };
+    };
+  };
+  return HEATPLAN_NONE;
+}
+
+static void heatPlanMarkAdd(uint16_t* marks, uint8_t* count, uint16_t minute)
+{
+  uint8_t pos = 0;
+  while ((pos < *count) && (marks[pos] < minute)) pos++;
+  if ((pos < *count) && (marks[pos] == minute)) return;
+  memmove(&marks[pos + 1], &marks[pos], (*count - pos) * sizeof(uint16_t));
+  marks[pos] = minute;
+  (*count)++;
+}
+
+static void heatPlanCompile()
+{
+  // Копия параметров одним блоком: критическая секция исключает запись на этом ядре. Если параметр изменится
+  // с другого ядра во время копирования, reParams уже после записи пришлет RE_PARAMS_CHANGED, таблица снова
+  // будет помечена как измененная и при следующем поиске скомпилирована заново
+  portENTER_CRITICAL(&_planMux);
+  memcpy(_plan, _periods, sizeof(_plan));
+  portEXIT_CRITICAL(&_planMux);
+
+  // Все границы периодов внутри недели, по возрастанию
+  uint16_t marks[HEATPLAN_POINTS];
+  uint8_t count = 0;
+  heatPlanMarkAdd(marks, &count, 0);
+  for (uint8_t i = 0; i < CONFIG_HEATPLAN_PERIODS; i++) {
+    if (heatPlanEnabled(&_plan[i])) {
+      for (uint8_t day = 0; day < 7; day++) {
+        if (_plan[i].days & (1U << day)) {
+          uint16_t start, length;
+          heatPlanInterval(&_plan[i], day, &start, &length);
+          heatPlanMarkAdd(marks, &count, start % HEATPLAN_WEEK_MINUTES);
+          heatPlanMarkAdd(marks, &count, (start + length) % HEATPLAN_WEEK_MINUTES);
+        };
+      };
+    };
+  };
+
+  // Соседние точки с одинаковым периодом объединяются
+  _pointsCount = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    int8_t period = heatPlanCovers(marks[i]);
+    if ((_pointsCount == 0) || (_points[_pointsCount - 1].period != period)) {
+      _points[_pointsCount].minute = marks[i];
+      _points[_pointsCount].period = period;
+      _pointsCount++;
+    };
+  };
+  rlog_i(logTAG, "Heating schedule compiled: %d transitions per week", _pointsCount - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Поиск --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool heatPlanLookup(time_t time, heat_plan_state_t* state)
+{
+  state->period = HEATPLAN_NONE;
+  state->temp = NAN;
+  state->hyst = NAN;
+  state->next = HEATPLAN_NONE;
+  state->next_temp = NAN;
+  state->next_hyst = NAN;
+  state->next_preheat = 0;
+  state->next_in = 0;
+  if (time < 1000000000) return false;
+
+  if (__atomic_exchange_n(&_planDirty, false, __ATOMIC_ACQ_REL)) {
+    heatPlanCompile();
+  };
+
+  struct tm ti;
+  localtime_r(&time, &ti);
+  uint16_t minute = ti.tm_wday * HEATPLAN_DAY_MINUTES + ti.tm_hour * 60 + ti.tm_min;
+
+  // Последняя точка, не превышающая текущую минуту (первая точка всегда 0)
+  uint8_t lo = 0;
+  uint8_t hi = _pointsCount - 1;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi + 1) / 2;
+    if (_points[mid].minute <= minute) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    };
+  };
+  state->period = _points[lo].period;
+  if (state->period != HEATPLAN_NONE) {
+    state->temp = _plan[state->period].temp;
+    state->hyst = _plan[state->period].hyst;
+  };
+
+  // Ближайшее начало другого периода (с переходом через конец недели)
+  for (uint8_t k = 1; k < _pointsCount; k++) {
+    heat_point_t* point = &_points[(lo + k) % _pointsCount];
+    if ((point->period != HEATPLAN_NONE) && (point->period != state->period)) {
+      uint32_t minutes = (point->minute + HEATPLAN_WEEK_MINUTES - minute) % HEATPLAN_WEEK_MINUTES;
+      state->next = point->period;
+      state->next_temp = _plan[point->period].temp;
+      state->next_hyst = _plan[point->period].hyst;
+      state->next_preheat = _plan[point->period].preheat;
+      state->next_in = minutes * 60 - ti.tm_sec;
+      break;
+    };
+  };
+  return true;
+}
+
+void heatPlanInvalidate()
+{
+  __atomic_store_n(&_planDirty, true, __ATOMIC_RELEASE);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Параметры ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void heatPlanParamsEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if ((event_id == RE_PARAMS_CHANGED) && (event_data)) {
+    uint32_t address = *(uint32_t*)event_data;
+    if ((address >= (uint32_t)&_periods[0]) && (address < (uint32_t)&_periods[CONFIG_HEATPLAN_PERIODS])) {
+      heatPlanInvalidate();
+    };
+  };
+}
+
+void heatPlanRegisterParameters(paramsGroupHandle_t parent)
+{
+  for (uint8_t i = 0; i < CONFIG_HEATPLAN_PERIODS; i++) {
+    // По умолчанию периоды не используются
+    _periods[i].days = 0;
+    _periods[i].time = 0;
+    _periods[i].temp = 20.0;
+    _periods[i].hyst = 1.0;
+    _periods[i].preheat = 0;
+
+    snprintf(_planKeys[i], sizeof(_planKeys[i]), "p%d", i + 1);
+    snprintf(_planNames[i], sizeof(_planNames[i]), "Период %d", i + 1);
+    paramsGroupHandle_t pgPeriod = paramsRegisterGroup(parent, _planKeys[i], _planKeys[i], _planNames[i]);
+    if (pgPeriod) {
+      paramsSetLimitsU8(
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPeriod,
+          HEATPLAN_DAYS_KEY, HEATPLAN_DAYS_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_periods[i].days),
+        0, 0x7F);
+      paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_TIMESPAN, nullptr, pgPeriod,
+        HEATPLAN_TIME_KEY, HEATPLAN_TIME_FRIENDLY,
+        CONFIG_MQTT_PARAMS_QOS, (void*)&_periods[i].time);
+      paramsSetLimitsFloat(
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgPeriod,
+          HEATPLAN_TEMP_KEY, HEATPLAN_TEMP_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_periods[i].temp),
+        5.0, 35.0);
+      paramsSetLimitsFloat(
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgPeriod,
+          HEATPLAN_HYST_KEY, HEATPLAN_HYST_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_periods[i].hyst),
+        0.1, 5.0);
+      paramsSetLimitsU16(
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U16, nullptr, pgPeriod,
+          HEATPLAN_PRE_KEY, HEATPLAN_PRE_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_periods[i].preheat),
+        0, CONFIG_HEATPLAN_PREHEAT_MAX);
+    };
+  };
+  heatPlanInvalidate();
+  eventHandlerRegister(RE_PARAMS_EVENTS, RE_PARAMS_CHANGED, &heatPlanParamsEventHandler, nullptr);
+}
@@ -0,0 +1,87 @@
+/*
+   Модуль недельного расписания термостата с уставками по периодам.
+   Расписание - таблица из CONFIG_HEATPLAN_PERIODS периодов, у каждого свои дни недели, интервал ЧЧММЧЧММ,
+   уставка температуры, гистерезис и время предварительного нагрева. Каждое поле периода - обычный параметр reParams
+   (хранится в NVS и изменяется через MQTT в подгруппе "p1".."pN" группы термостата). Таблица не хранится одним блоком:
+   строковых параметров с разбором JSON reParams не поддерживает, а отдельные поля можно менять по одному.
+   При изменении параметров таблица один раз "компилируется" в упорядоченный список точек переключения
+   внутри недели, и активный период находится двоичным поиском по текущей минуте недели.
+   Если периоды перекрываются, действует период с меньшим номером
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __HEATPLAN_H__
+#define __HEATPLAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rTypes.h"
+#include "reParams.h"
+#include "project_config.h"
+
+// Количество периодов в расписании
+#ifndef CONFIG_HEATPLAN_PERIODS
+#define CONFIG_HEATPLAN_PERIODS 6
+#endif // CONFIG_HEATPLAN_PERIODS
+
+// Максимальное время предварительного нагрева, минут
+#ifndef CONFIG_HEATPLAN_PREHEAT_MAX
+#define CONFIG_HEATPLAN_PREHEAT_MAX 720
+#endif // CONFIG_HEATPLAN_PREHEAT_MAX
+
+#define HEATPLAN_NONE -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Период расписания. Период не используется, если days или time равны 0.
+ * Маска дней: бит 0 - воскресенье ... бит 6 - суббота (как tm_wday); если конец интервала меньше начала,
+ * период продолжается до утра следующего дня, если равен - занимает весь день
+ * */
+typedef struct {
+  uint8_t days;
+  timespan_t time;
+  float temp;
+  float hyst;
+  uint16_t preheat;         // Время предварительного нагрева перед началом периода, минут
+} heat_period_t;
+
+/**
+ * Результат поиска по расписанию
+ * */
+typedef struct {
+  int8_t period;            // Активный период или HEATPLAN_NONE
+  float temp;
+  float hyst;
+  int8_t next;              // Следующий период или HEATPLAN_NONE
+  float next_temp;
+  float next_hyst;
+  uint16_t next_preheat;
+  uint32_t next_in;         // Время до начала следующего периода, секунд
+} heat_plan_state_t;
+
+/**
+ * Регистрация параметров периодов в группе parent
+ * */
+void heatPlanRegisterParameters(paramsGroupHandle_t parent);
+
+/**
+ * Поиск активного и следующего периода на момент time. Возвращает false, если время не синхронизировано
+ * */
+bool heatPlanLookup(time_t time, heat_plan_state_t* state);
+
+/**
+ * Принудительная перекомпиляция таблицы (например, после программного изменения периодов)
+ * */
+void heatPlanInvalidate();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HEATPLAN_H__
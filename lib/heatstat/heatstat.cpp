@@ -0,0 +1,312 @@
+#include "heatstat.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "rLog.h"
+#include "reNvs.h"
+#if defined(CONFIG_ELTARIFFS_ENABLED) && CONFIG_ELTARIFFS_ENABLED
+#include "reElTariffs.h"
+#endif // CONFIG_ELTARIFFS_ENABLED
+
+static const char* logTAG = "HSTAT";
+static const char* heatStatNvsGroup = "heatstat";
+static const char* heatStatNvsKey = "data";
+
+#define HEATSTAT_POWER_KEY          "boiler_power"
+#define HEATSTAT_POWER_FRIENDLY     "Мощность котла, кВт"
+#define HEATSTAT_PRICE_KEY          "energy_price"
+#define HEATSTAT_PRICE_FRIENDLY     "Стоимость кВт·ч"
+
+// Минимум градусо-часов (1 градусо-день) и учтенного времени, при которых нормированное время работы имеет смысл
+#define HEATSTAT_NORM_MIN_DEGREE_H  24.0
+#define HEATSTAT_NORM_MIN_TOTAL_S   43200.0
+// Минимум суток для оценки тренда
+#define HEATSTAT_TREND_MIN_DAYS     3
+
+// Все, что сохраняется в NVS, одним блоком
+typedef struct {
+  uint8_t head;                                 // Позиция для следующих суток в кольцевом буфере
+  heat_stat_t today;
+  heat_stat_t days[CONFIG_HEATSTAT_DAYS];
+} heat_stat_store_t;
+
+static heat_stat_store_t _stat;
+static heat_stat_t _hour;                       // Текущий час
+static heat_stat_t _hourLast;                   // Последний завершенный час
+static uint32_t _hourKey = 0;
+static int64_t _lastTick = 0;
+static float _trend = NAN;
+static portMUX_TYPE _statMux = portMUX_INITIALIZER_UNLOCKED;
+
+static float _boilerPower = 24.0;
+static float _energyPrice = 0.0;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Агрегаты -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void heatStatAppend(heat_stat_t* dst, const heat_stat_t* src)
+{
+  dst->total_s += src->total_s;
+  dst->on_s += src->on_s;
+  dst->flow_s += src->flow_s;
+  dst->flow_sum += src->flow_sum;
+  dst->degree_h += src->degree_h;
+  dst->energy += src->energy;
+  dst->cost += src->cost;
+}
+
+static void heatStatClear(heat_stat_t* stat, uint32_t day)
+{
+  memset(stat, 0, sizeof(heat_stat_t));
+  stat->day = day;
+}
+
+// Часы работы котла на один градусо-день
+static float heatStatNorm(const heat_stat_t* stat, float minTotal)
+{
+  if ((stat->degree_h >= HEATSTAT_NORM_MIN_DEGREE_H) && (stat->total_s >= minTotal)) {
+    return (stat->on_s / 3600.0) / (stat->degree_h / 24.0);
+  };
+  return NAN;
+}
+
+// Примерный порядковый номер суток: для наклона достаточно монотонности, ошибка на стыке лет не больше суток
+static int32_t heatStatDayNumber(uint32_t day)
+{
+  return (int32_t)(day / 1000) * 365 + (int32_t)(day % 1000);
+}
+
+// Наклон нормированного времени работы по суткам методом наименьших квадратов, % от среднего в сутки
+static float heatStatTrend()
+{
+  int32_t base = 0;
+  uint8_t n = 0;
+  float sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+  for (uint8_t i = 0; i < CONFIG_HEATSTAT_DAYS; i++) {
+    float norm = heatStatNorm(&_stat.days[i], HEATSTAT_NORM_MIN_TOTAL_S);
+    if ((_stat.days[i].day > 0) && !isnan(norm)) {
+      if (n == 0) base = heatStatDayNumber(_stat.days[i].day);
+      float x = (float)(heatStatDayNumber(_stat.days[i].day) - base);
+      sx += x;
+      sy += norm;
+      sxx += x * x;
+      sxy += x * norm;
+      n++;
+    };
+  };
+  if (n >= HEATSTAT_TREND_MIN_DAYS) {
+    float d = n * sxx - sx * sx;
+    if ((d > 0.0) && (sy > 0.0)) {
+      return 100.0 * ((n * sxy - sx * sy) / d) / (sy / n);
+    };
+  };
+  return NAN;
+}
+
+static void heatStatHourClose()
+{
+  portENTER_CRITICAL(&_statMux);
+  heatStatAppend(&_stat.today, &_hour);
+  _hourLast = _hour;
+  heatStatClear(&_hour, 0);
+  portEXIT_CRITICAL(&_statMux);
+}
+
+static void heatStatDayClose(uint32_t day)
+{
+  portENTER_CRITICAL(&_statMux);
+  _stat.days[_stat.head] = _stat.today;
+  _stat.head = (_stat.head + 1) % CONFIG_HEATSTAT_DAYS;
+  heatStatClear(&_stat.today, day);
+  portEXIT_CRITICAL(&_statMux);
+
+  _trend = heatStatTrend();
+  rlog_i(logTAG, "Heating day closed, efficiency trend: %.2f %%/day", _trend);
+  heatStatStore();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Измерения ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static float heatStatPrice()
+{
+  #if defined(CONFIG_ELTARIFFS_ENABLED) && CONFIG_ELTARIFFS_ENABLED
+    float price = elTariffsGetTariffPrice();
+    if (price > 0.0) return price;
+  #endif // CONFIG_ELTARIFFS_ENABLED
+  return _energyPrice;
+}
+
+bool heatStatUpdate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow)
+{
+  bool hourDone = false;
+
+  // Границы часа и суток - по местному времени, до синхронизации часов данные копятся в текущем часе
+  time_t now = time(nullptr);
+  if (now > 1000000000) {
+    struct tm ti;
+    localtime_r(&now, &ti);
+    uint32_t day = (ti.tm_year + 1900) * 1000 + ti.tm_yday;
+    uint32_t hour = day * 24 + ti.tm_hour;
+    if (_stat.today.day == 0) {
+      _stat.today.day = day;
+    };
+    if ((_hourKey > 0) && (_hourKey != hour)) {
+      heatStatHourClose();
+      hourDone = true;
+    };
+    _hourKey = hour;
+    if (_stat.today.day != day) {
+      heatStatDayClose(day);
+    };
+  };
+
+  // Интегрирование по фактическому интервалу между вызовами
+  int64_t tick = esp_timer_get_time();
+  if (_lastTick > 0) {
+    float dt = (float)(tick - _lastTick) / 1000000.0;
+    if ((dt > 0.0) && (dt <= CONFIG_HEATSTAT_MAX_GAP)) {
+      float energy = boilerOn ? _boilerPower * dt / 3600.0 : 0.0;
+      float cost = energy * heatStatPrice();
+      portENTER_CRITICAL(&_statMux);
+      _hour.total_s += dt;
+      if (boilerOn) {
+        _hour.on_s += dt;
+        _hour.energy += energy;
+        _hour.cost += cost;
+        if (!isnan(tempFlow)) {
+          _hour.flow_s += dt;
+          _hour.flow_sum += tempFlow * dt;
+        };
+      };
+      if (!isnan(tempIndoor) && !isnan(tempOutdoor) && (tempIndoor > tempOutdoor)) {
+        _hour.degree_h += (tempIndoor - tempOutdoor) * dt / 3600.0;
+      };
+      portEXIT_CRITICAL(&_statMux);
+    };
+  };
+  _lastTick = tick;
+
+  return hourDone;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Сводка -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Вещественное значение для JSON: NAN публикуется как null
+static const char* heatStatFloat(char* buf, size_t size, float value, uint8_t decimals)
+{
+  if (isnan(value)) {
+    strncpy(buf, "null", size);
+  } else {
+    snprintf(buf, size, "%.*f", decimals, value);
+  };
+  return buf;
+}
+
+static float heatStatPercent(float part, float total)
+{
+  return total > 0.0 ? 100.0 * part / total : NAN;
+}
+
+char* heatStatGetJson(scratch_arena_t* arena)
+{
+  heat_stat_t hour, today, period;
+  uint8_t days = 0;
+  heatStatClear(&period, 0);
+  portENTER_CRITICAL(&_statMux);
+  hour = _hourLast;
+  today = _stat.today;
+  heatStatAppend(&today, &_hour);
+  for (uint8_t i = 0; i < CONFIG_HEATSTAT_DAYS; i++) {
+    if (_stat.days[i].day > 0) {
+      heatStatAppend(&period, &_stat.days[i]);
+      days++;
+    };
+  };
+  portEXIT_CRITICAL(&_statMux);
+
+  char hDuty[16], tDuty[16], tFlow[16], tNorm[16], pNorm[16], pTrend[16];
+  return scratchPrintf(arena,
+    "{\"hour\":{\"on\":%.1f,\"duty\":%s,\"degree_hours\":%.2f,\"energy\":%.3f,\"cost\":%.2f},"
+    "\"today\":{\"on\":%.1f,\"duty\":%s,\"flow\":%s,\"degree_days\":%.2f,\"energy\":%.2f,\"cost\":%.2f,\"norm\":%s},"
+    "\"period\":{\"days\":%d,\"on\":%.2f,\"degree_days\":%.2f,\"energy\":%.2f,\"cost\":%.2f,\"norm\":%s,\"trend\":%s}}",
+    hour.on_s / 60.0, heatStatFloat(hDuty, sizeof(hDuty), heatStatPercent(hour.on_s, hour.total_s), 1),
+    hour.degree_h, hour.energy, hour.cost,
+    today.on_s / 60.0, heatStatFloat(tDuty, sizeof(tDuty), heatStatPercent(today.on_s, today.total_s), 1),
+    heatStatFloat(tFlow, sizeof(tFlow), today.flow_s > 0.0 ? today.flow_sum / today.flow_s : NAN, 1),
+    today.degree_h / 24.0, today.energy, today.cost,
+    heatStatFloat(tNorm, sizeof(tNorm), heatStatNorm(&today, 0.0), 3),
+    days, period.on_s / 3600.0, period.degree_h / 24.0, period.energy, period.cost,
+    heatStatFloat(pNorm, sizeof(pNorm), heatStatNorm(&period, days * HEATSTAT_NORM_MIN_TOTAL_S), 3),
+    heatStatFloat(pTrend, sizeof(pTrend), _trend, 2));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- NVS ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void heatStatInit()
+{
+  memset(&_stat, 0, sizeof(_stat));
+  heatStatClear(&_hour, 0);
+  heatStatClear(&_hourLast, 0);
+
+  nvs_handle_t nvsHandle;
+  if (nvsOpen(heatStatNvsGroup, NVS_READONLY, &nvsHandle)) {
+    heat_stat_store_t data;
+    size_t size = sizeof(data);
+    // Блок другого размера (изменилось CONFIG_HEATSTAT_DAYS) не восстанавливается
+    if ((nvs_get_blob(nvsHandle, heatStatNvsKey, &data, &size) == ESP_OK) && (size == sizeof(data))
+     && (data.head < CONFIG_HEATSTAT_DAYS)) {
+      _stat = data;
+      rlog_i(logTAG, "Heating statistics restored from NVS");
+    };
+    nvs_close(nvsHandle);
+  };
+  _trend = heatStatTrend();
+}
+
+void heatStatStore()
+{
+  heat_stat_store_t data;
+  portENTER_CRITICAL(&_statMux);
+  data = _stat;
+  portEXIT_CRITICAL(&_statMux);
+
+  nvs_handle_t nvsHandle;
+  if (nvsOpen(heatStatNvsGroup, NVS_READWRITE, &nvsHandle)) {
+    esp_err_t err = nvs_set_blob(nvsHandle, heatStatNvsKey, &data, sizeof(data));
+    if (err == ESP_OK) {
+      err = nvs_commit(nvsHandle);
+    };
+    if (err != ESP_OK) {
+      rlog_e(logTAG, "Failed to store heating statistics: %d (%s)", err, esp_err_to_name(err));
+    };
+    nvs_close(nvsHandle);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Параметры ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void heatStatRegisterParameters(paramsGroupHandle_t parent)
+{
+  paramsSetLimitsFloat(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, parent,
+      HEATSTAT_POWER_KEY, HEATSTAT_POWER_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_boilerPower),
+    0.0, 100.0);
+  paramsSetLimitsFloat(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, parent,
+      HEATSTAT_PRICE_KEY, HEATSTAT_PRICE_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_energyPrice),
+    0.0, 1000.0);
+}
@@ -0,0 +1,84 @@
+/*
+   Модуль аналитики отопления: время работы котла, средняя температура теплоносителя, градусо-часы
+   (разница температур в доме и на улице, проинтегрированная по времени), оценка потребленной энергии и ее стоимости.
+   Все величины накапливаются инкрементально на каждом цикле сенсоров в агрегатах текущего часа и текущих суток;
+   по окончании суток агрегат переносится в кольцевой буфер последних CONFIG_HEATSTAT_DAYS суток (хранится в NVS).
+
+   Нормированное время работы - часы работы котла на один градусо-день. Оно не зависит от погоды, поэтому его рост
+   от суток к суткам (тренд, % в сутки по методу наименьших квадратов) указывает на ухудшение теплоизоляции или котла.
+   Модуль не публикует данные сам: heatStatUpdate() сообщает о завершении очередного часа, после чего
+   вызывающий код формирует сводку heatStatGetJson() в своей арене и отправляет ее на MQTT брокер
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __HEATSTAT_H__
+#define __HEATSTAT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "reParams.h"
+#include "scratch.h"
+#include "project_config.h"
+
+// Количество суток в кольцевом буфере
+#ifndef CONFIG_HEATSTAT_DAYS
+#define CONFIG_HEATSTAT_DAYS 7
+#endif // CONFIG_HEATSTAT_DAYS
+
+// Перерыв между измерениями, после которого интервал не учитывается (например, после длительного обновления), секунд
+#ifndef CONFIG_HEATSTAT_MAX_GAP
+#define CONFIG_HEATSTAT_MAX_GAP 600
+#endif // CONFIG_HEATSTAT_MAX_GAP
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Агрегат за интервал (час, сутки)
+ * */
+typedef struct {
+  uint32_t day;             // Идентификатор суток: год * 1000 + номер дня в году (0 - не определен)
+  float total_s;            // Учтенное время, с
+  float on_s;               // Время работы котла, с
+  float flow_s;             // Время работы котла с исправным датчиком теплоносителя, с
+  float flow_sum;           // Интеграл температуры теплоносителя при работающем котле, °С·с
+  float degree_h;           // Градусо-часы (в доме минус на улице), °С·ч
+  float energy;             // Оценка потребленной энергии, кВт·ч
+  float cost;               // Оценка стоимости
+} heat_stat_t;
+
+/**
+ * Восстановление накопленных данных из NVS
+ * */
+void heatStatInit();
+
+/**
+ * Сохранение накопленных данных в NVS
+ * */
+void heatStatStore();
+
+/**
+ * Параметры: мощность котла (кВт) и цена за кВт·ч (при включенных тарифах reElTariffs используется цена текущего тарифа)
+ * */
+void heatStatRegisterParameters(paramsGroupHandle_t parent);
+
+/**
+ * Очередное измерение (вызывается на каждом цикле сенсоров), температуры могут быть NAN.
+ * Возвращает true, если завершился очередной час и сводку пора опубликовать
+ * */
+bool heatStatUpdate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow);
+
+/**
+ * Сводка за последний завершенный час, текущие сутки и последние CONFIG_HEATSTAT_DAYS суток
+ * в формате JSON, размещается в арене arena (nullptr, если не поместилась)
+ * */
+char* heatStatGetJson(scratch_arena_t* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HEATSTAT_H__
@@ -0,0 +1,233 @@
+#include "i2cbatch.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "def_consts.h"
+#include "rLog.h"
+#include "reI2C.h"
+
+static const char* logTAG = "I2C";
+
+#define ERROR_I2C_READ            "Error reading device on bus %d at address 0x%.2X: #%d %s!"
+#define ERROR_I2C_WRITE           "Error writing to device on bus %d at address 0x%.2X: #%d %s!"
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Блокировка шины ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Если блокировка reI2C включена, используется тот же рекурсивный мьютекс, что и в readI2C() / writeI2C(),
+// иначе собственный мьютекс модуля (защищает только пакеты друг от друга)
+#if defined(CONFIG_I2C_LOCK) && CONFIG_I2C_LOCK
+  extern SemaphoreHandle_t _lockI2C[I2C_NUM_MAX];
+  static SemaphoreHandle_t batchLockI2C(i2c_port_t i2c_num) { return _lockI2C[i2c_num]; }
+#else
+  static SemaphoreHandle_t _lockBatch[I2C_NUM_MAX] = { nullptr };
+  static StaticSemaphore_t _buffMutexBatch[I2C_NUM_MAX];
+  static SemaphoreHandle_t batchLockI2C(i2c_port_t i2c_num)
+  {
+    if (_lockBatch[i2c_num] == nullptr) {
+      _lockBatch[i2c_num] = xSemaphoreCreateRecursiveMutexStatic(&_buffMutexBatch[i2c_num]);
+    };
+    return _lockBatch[i2c_num];
+  }
+#endif // CONFIG_I2C_LOCK
+
+// Статический буфер цепочки команд: одна операция - не более двух транзакций (запись команды + чтение)
+static uint8_t _linkBuffer[I2C_NUM_MAX][I2C_LINK_RECOMMENDED_SIZE(2)];
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Статистика -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#ifndef CONFIG_I2C_BATCH_STATS_SIZE
+#define CONFIG_I2C_BATCH_STATS_SIZE 8
+#endif // CONFIG_I2C_BATCH_STATS_SIZE
+
+static i2c_dev_stats_t _stats[CONFIG_I2C_BATCH_STATS_SIZE];
+static uint8_t _statsCount = 0;
+static portMUX_TYPE _statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void i2cBatchStatsUpdate(i2c_port_t i2c_num, const uint8_t i2c_address, esp_err_t err, uint32_t latency_us)
+{
+  portENTER_CRITICAL(&_statsMux);
+  i2c_dev_stats_t* item = nullptr;
+  for (uint8_t i = 0; i < _statsCount; i++) {
+    if ((_stats[i].port == i2c_num) && (_stats[i].address == i2c_address)) {
+      item = &_stats[i];
+      break;
+    };
+  };
+  if ((item == nullptr) && (_statsCount < CONFIG_I2C_BATCH_STATS_SIZE)) {
+    item = &_stats[_statsCount++];
+    memset(item, 0, sizeof(i2c_dev_stats_t));
+    item->port = i2c_num;
+    item->address = i2c_address;
+    item->latency_min_us = UINT32_MAX;
+  };
+  if (item) {
+    item->ops++;
+    if (err == ESP_OK) {
+      if (latency_us < item->latency_min_us) item->latency_min_us = latency_us;
+      if (latency_us > item->latency_max_us) item->latency_max_us = latency_us;
+      item->latency_total_us += latency_us;
+    } else if (err == ESP_FAIL) {
+      // i2c_master_cmd_begin() возвращает ESP_FAIL, если ведомое устройство не ответило ACK
+      item->nacks++;
+    } else if (err == ESP_ERR_TIMEOUT) {
+      item->timeouts++;
+    } else {
+      item->errors++;
+    };
+  };
+  portEXIT_CRITICAL(&_statsMux);
+}
+
+bool i2cBatchStatsAppend(scratch_arena_t* arena, char** json)
+{
+  i2c_dev_stats_t item;
+  bool ok = scratchAppendf(arena, json, nullptr, "{");
+  uint8_t count = _statsCount;
+  for (uint8_t i = 0; ok && (i < count); i++) {
+    portENTER_CRITICAL(&_statsMux);
+    item = _stats[i];
+    portEXIT_CRITICAL(&_statsMux);
+    uint32_t good = item.ops - item.nacks - item.timeouts - item.errors;
+    ok = scratchAppendf(arena, json, i > 0 ? "," : nullptr, 
+      "\"%d:0x%.2X\":{\"ops\":%" PRIu32 ",\"nacks\":%" PRIu32 ",\"timeouts\":%" PRIu32 ",\"errors\":%" PRIu32 
+      ",\"min_us\":%" PRIu32 ",\"avg_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "}",
+      (int)item.port, item.address, item.ops, item.nacks, item.timeouts, item.errors,
+      good > 0 ? item.latency_min_us : 0, good > 0 ? (uint32_t)(item.latency_total_us / good) : 0, item.latency_max_us);
+  };
+  return ok && scratchAppendf(arena, json, nullptr, "}");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Пакеты -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void i2cBatchInit(i2c_batch_t* batch, i2c_port_t i2c_num, TickType_t timeout)
+{
+  memset(batch, 0, sizeof(i2c_batch_t));
+  batch->port = i2c_num;
+  batch->timeout = timeout;
+  batch->result = ESP_OK;
+}
+
+static i2c_op_t* i2cBatchAdd(i2c_batch_t* batch, i2c_op_type_t type, const uint8_t i2c_address,
+  const uint8_t* cmds, const size_t cmds_size, uint8_t* data, const size_t data_size, const uint32_t wait_us)
+{
+  if ((batch->count >= CONFIG_I2C_BATCH_MAX_OPS) || (cmds_size > CONFIG_I2C_BATCH_MAX_CMDS)) {
+    rlog_e(logTAG, "Failed to add operation for device 0x%.2X to batch: batch is full", i2c_address);
+    return nullptr;
+  };
+  i2c_op_t* op = &batch->ops[batch->count++];
+  op->type = type;
+  op->address = i2c_address;
+  op->cmds_size = (cmds) ? cmds_size : 0;
+  if (op->cmds_size > 0) {
+    memcpy(op->cmds, cmds, op->cmds_size);
+  };
+  op->data = data;
+  op->data_size = (data) ? data_size : 0;
+  op->wait_us = wait_us;
+  op->result = ESP_ERR_INVALID_STATE; // еще не выполнено
+  return op;
+}
+
+bool i2cBatchAddWrite(i2c_batch_t* batch, const uint8_t i2c_address,
+  const uint8_t* cmds, const size_t cmds_size, uint8_t* data, const size_t data_size)
+{
+  return i2cBatchAdd(batch, I2C_OP_WRITE, i2c_address, cmds, cmds_size, data, data_size, 0) != nullptr;
+}
+
+bool i2cBatchAddRead(i2c_batch_t* batch, const uint8_t i2c_address,
+  const uint8_t* cmds, const size_t cmds_size, uint8_t* data, const size_t data_size, const uint32_t wait_us)
+{
+  if ((data == nullptr) || (data_size == 0)) return false;
+  return i2cBatchAdd(batch, I2C_OP_READ, i2c_address, cmds, cmds_size, data, data_size, wait_us) != nullptr;
+}
+
+// Выполнение одной цепочки команд с учетом времени выполнения
+static esp_err_t i2cBatchBegin(i2c_port_t i2c_num, i2c_cmd_handle_t cmdLink, TickType_t timeout, uint32_t* latency_us)
+{
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = i2c_master_cmd_begin(i2c_num, cmdLink, pdMS_TO_TICKS(timeout));
+  *latency_us += (uint32_t)(esp_timer_get_time() - start);
+  return err;
+}
+
+#define BATCH_CHECK(x) do { err = (x); if (err != ESP_OK) goto end; } while (0)
+
+static esp_err_t i2cBatchExecOp(i2c_port_t i2c_num, i2c_op_t* op, TickType_t timeout)
+{
+  esp_err_t err = ESP_OK;
+  uint32_t latency_us = 0;
+  i2c_cmd_handle_t cmdLink = i2c_cmd_link_create_static(_linkBuffer[i2c_num], sizeof(_linkBuffer[i2c_num]));
+  if (cmdLink == nullptr) return ESP_ERR_NO_MEM;
+
+  if (op->type == I2C_OP_WRITE) {
+    BATCH_CHECK(i2c_master_start(cmdLink));
+    BATCH_CHECK(i2c_master_write_byte(cmdLink, (op->address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN));
+    if (op->cmds_size > 0) {
+      BATCH_CHECK(i2c_master_write(cmdLink, op->cmds, op->cmds_size, ACK_CHECK_EN));
+    };
+    if (op->data_size > 0) {
+      BATCH_CHECK(i2c_master_write(cmdLink, op->data, op->data_size, ACK_CHECK_EN));
+    };
+    BATCH_CHECK(i2c_master_stop(cmdLink));
+    BATCH_CHECK(i2cBatchBegin(i2c_num, cmdLink, timeout, &latency_us));
+  } else {
+    if (op->cmds_size > 0) {
+      BATCH_CHECK(i2c_master_start(cmdLink));
+      BATCH_CHECK(i2c_master_write_byte(cmdLink, (op->address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN));
+      BATCH_CHECK(i2c_master_write(cmdLink, op->cmds, op->cmds_size, ACK_CHECK_EN));
+      // Если нужна пауза, отправляем команду отдельно и освобождаем линию
+      if (op->wait_us > 0) {
+        BATCH_CHECK(i2c_master_stop(cmdLink));
+        BATCH_CHECK(i2cBatchBegin(i2c_num, cmdLink, timeout, &latency_us));
+        i2c_cmd_link_delete_static(cmdLink);
+        ets_delay_us(op->wait_us);
+        cmdLink = i2c_cmd_link_create_static(_linkBuffer[i2c_num], sizeof(_linkBuffer[i2c_num]));
+        if (cmdLink == nullptr) return ESP_ERR_NO_MEM;
+      };
+    };
+    // Чтение данных (при отсутствии паузы - через повторный START)
+    BATCH_CHECK(i2c_master_start(cmdLink));
+    BATCH_CHECK(i2c_master_write_byte(cmdLink, (op->address << 1) | I2C_MASTER_READ, ACK_CHECK_EN));
+    BATCH_CHECK(i2c_master_read(cmdLink, op->data, op->data_size, I2C_MASTER_LAST_NACK));
+    BATCH_CHECK(i2c_master_stop(cmdLink));
+    BATCH_CHECK(i2cBatchBegin(i2c_num, cmdLink, timeout, &latency_us));
+  };
+
+end:
+  i2c_cmd_link_delete_static(cmdLink);
+  i2cBatchStatsUpdate(i2c_num, op->address, err, latency_us);
+  if (err != ESP_OK) {
+    rlog_e(logTAG, op->type == I2C_OP_WRITE ? ERROR_I2C_WRITE : ERROR_I2C_READ, i2c_num, op->address, err, esp_err_to_name(err));
+  };
+  return err;
+}
+
+esp_err_t i2cBatchExec(i2c_batch_t* batch)
+{
+  batch->result = ESP_OK;
+  SemaphoreHandle_t lock = batchLockI2C(batch->port);
+  if (lock == nullptr) {
+    batch->result = ESP_ERR_INVALID_STATE;
+    return batch->result;
+  };
+
+  // Один захват шины на весь пакет
+  while (xSemaphoreTakeRecursive(lock, portMAX_DELAY) != pdPASS);
+  for (uint8_t i = 0; i < batch->count; i++) {
+    batch->ops[i].result = i2cBatchExecOp(batch->port, &batch->ops[i], batch->timeout);
+    if ((batch->ops[i].result != ESP_OK) && (batch->result == ESP_OK)) {
+      batch->result = batch->ops[i].result;
+    };
+  };
+  xSemaphoreGiveRecursive(lock);
+  return batch->result;
+}
@@ -0,0 +1,103 @@
+/*
+   Модуль пакетного выполнения транзакций I2C: несколько операций чтения и записи для разных устройств
+   на одной шине выполняются за один захват шины, со сбором статистики задержек и ошибок (NACK) по каждому устройству.
+   Статистика публикуется в составе метрик производительности (perfstat, раздел "i2c")
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __I2CBATCH_H__
+#define __I2CBATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/i2c.h"
+#include "project_config.h"
+#include "scratch.h"
+
+#ifndef CONFIG_I2C_BATCH_MAX_OPS
+#define CONFIG_I2C_BATCH_MAX_OPS 8
+#endif // CONFIG_I2C_BATCH_MAX_OPS
+
+#ifndef CONFIG_I2C_BATCH_MAX_CMDS
+#define CONFIG_I2C_BATCH_MAX_CMDS 4
+#endif // CONFIG_I2C_BATCH_MAX_CMDS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  I2C_OP_WRITE = 0,
+  I2C_OP_READ
+} i2c_op_type_t;
+
+typedef struct {
+  i2c_op_type_t type;
+  uint8_t address;
+  uint8_t cmds[CONFIG_I2C_BATCH_MAX_CMDS];     // Команды (адрес регистра) копируются в операцию
+  uint8_t cmds_size;
+  uint8_t* data;                              // Буфер данных должен существовать до завершения пакета
+  size_t data_size;
+  uint32_t wait_us;                           // Пауза между командой и чтением с освобождением линии (0 - повторный START)
+  esp_err_t result;
+} i2c_op_t;
+
+typedef struct {
+  i2c_port_t port;
+  uint8_t count;
+  i2c_op_t ops[CONFIG_I2C_BATCH_MAX_OPS];
+  TickType_t timeout;
+  esp_err_t result;
+} i2c_batch_t;
+
+// Статистика по устройству на шине
+typedef struct {
+  i2c_port_t port;
+  uint8_t address;
+  uint32_t ops;
+  uint32_t nacks;
+  uint32_t timeouts;
+  uint32_t errors;
+  uint32_t latency_min_us;
+  uint32_t latency_max_us;
+  uint64_t latency_total_us;
+} i2c_dev_stats_t;
+
+/**
+ * Подготовка пустого пакета для шины i2c_num
+ * */
+void i2cBatchInit(i2c_batch_t* batch, i2c_port_t i2c_num, TickType_t timeout);
+
+/**
+ * Добавление в пакет операции записи: START, адрес, команды, данные, STOP
+ * */
+bool i2cBatchAddWrite(i2c_batch_t* batch, const uint8_t i2c_address,
+  const uint8_t* cmds, const size_t cmds_size, uint8_t* data, const size_t data_size);
+
+/**
+ * Добавление в пакет операции чтения: START, адрес, команды, [STOP, пауза], START, адрес, чтение, STOP
+ * */
+bool i2cBatchAddRead(i2c_batch_t* batch, const uint8_t i2c_address,
+  const uint8_t* cmds, const size_t cmds_size, uint8_t* data, const size_t data_size, const uint32_t wait_us);
+
+/**
+ * Синхронное выполнение всех операций пакета за один захват шины.
+ * Ошибка одной операции не прерывает выполнение остальных, возвращается первая ошибка
+ * */
+esp_err_t i2cBatchExec(i2c_batch_t* batch);
+
+/**
+ * Статистика всех устройств с момента запуска в формате JSON, дописывается в строку json арены arena
+ * (подходит как раздел perfSectionRegister())
+ * */
+bool i2cBatchStatsAppend(scratch_arena_t* arena, char** json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __I2CBATCH_H__
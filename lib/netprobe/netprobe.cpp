@@ -0,0 +1,970 @@
+#include "netprobe.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/opt.h"
+#include "lwip/icmp.h"
+#include "lwip/dns.h"
+#include "lwip/inet.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/sockets.h"
+#include "rLog.h"
+#include "reEsp32.h"
+#include "reParams.h"
+#include "perfstat.h"
+#if CONFIG_MQTT_PINGER_ENABLE
+#include "rePingerMqtt.h"
+#endif // CONFIG_MQTT_PINGER_ENABLE
+#if CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+#include "rePingerOM.h"
+#endif // CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+
+#if CONFIG_PINGER_ENABLE && CONFIG_NETPROBE_ENABLE
+
+static const char* logTAG = "PING";
+static const char* netprobeTaskName = "netprobe";
+
+static const uint8_t PROBE_START = BIT0;
+static const uint8_t PROBE_STOP  = BIT1;
+
+#define NETPROBE_HOSTS_MAX 5
+#define NETPROBE_RTT_LOST  0xFFFF
+#define NETPROBE_DATA_MAX  255
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Данные --------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  const char* host_name;
+  uint16_t id;
+  bool inet;                                 // Хост участвует в кворуме доступа в интернет
+  re_ping_event_id_t evid_available;
+  re_ping_event_id_t evid_unavailable;
+  // Адрес хоста
+  ip_addr_t host_addr;
+  volatile TickType_t host_resolved;
+  volatile bool dns_pending;
+  bool dns_async;
+  struct sockaddr_in target_addr;
+  // Текущий пакет
+  uint16_t seqno;
+  int64_t sent_us;
+  bool waiting;
+  // Результаты текущего раунда
+  uint32_t transmitted;
+  uint32_t received;
+  uint32_t total_time_ms;
+  uint16_t round_rtt[CONFIG_NETPROBE_WINDOW];
+  uint16_t duration_ms;
+  float loss;
+  uint8_t ttl;
+  ping_state_t state;
+  // Скользящее окно RTT последних пакетов (NETPROBE_RTT_LOST - пакет потерян)
+  uint16_t window[CONFIG_NETPROBE_WINDOW];
+  uint8_t window_index;
+  uint8_t window_count;
+  uint16_t rtt_p50;
+  uint16_t rtt_p95;
+  float window_loss;
+  // Счетчики недоступности
+  uint32_t limit_unavailable;
+  uint32_t count_unavailable;
+  time_t time_unavailable;
+  bool notify_unavailable;
+} netprobe_host_t;
+
+static netprobe_host_t _hosts[NETPROBE_HOSTS_MAX];
+static uint8_t _hostsCount = 0;
+static int _sock = -1;
+static uint8_t _packet[sizeof(struct icmp_echo_hdr) + NETPROBE_DATA_MAX];
+static portMUX_TYPE _statsMux = portMUX_INITIALIZER_UNLOCKED;
+// Поколение запросов DNS: ответ, пришедший после таймаута ожидания, относится к прошлому поколению и игнорируется
+static portMUX_TYPE _dnsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t _dnsGeneration = 0;
+
+static TaskHandle_t _netprobeTask = nullptr;
+
+#if CONFIG_PINGER_TASK_STATIC_ALLOCATION
+static StaticTask_t _netprobeTaskBuffer;
+static StackType_t _netprobeTaskStack[CONFIG_PINGER_TASK_STACK_SIZE];
+#endif // CONFIG_PINGER_TASK_STATIC_ALLOCATION
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Параметры ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static uint8_t _pingCount = CONFIG_PINGER_PARAM_COUNT;
+static uint16_t _pingTimeout = CONFIG_PINGER_PARAM_TIMEOUT;
+static uint8_t _pingPacket = CONFIG_PINGER_PARAM_DATASIZE;
+static uint8_t _quorum = CONFIG_NETPROBE_QUORUM;
+static uint8_t _resultMode = CONFIG_PINGER_TOTAL_RESULT_MODE;
+static uint32_t _maxSlowdownDuration = CONFIG_PINGER_SLOWDOWN_DURATION;
+static float _maxSlowdownLoss = CONFIG_PINGER_SLOWDOWN_LOSS;
+static uint32_t _maxUnavailableDuration = CONFIG_PINGER_UNAVAILABLE_DURATION;
+static float _maxUnavailableLoss = CONFIG_PINGER_UNAVAILABLE_LOSS;
+static uint8_t _thresholdUnavailable = CONFIG_PINGER_UNAVAILABLE_THRESHOLD;
+static uint32_t _intervalAvailable = CONFIG_PINGER_INTERVAL_AVAILABLE;
+static uint32_t _intervalUnavailable = CONFIG_PINGER_INTERVAL_UNAVAILABLE;
+
+static void netprobeParamsRegister()
+{
+  // Ключи параметров совпадают с rePinger, поэтому ранее сохраненные значения сохраняются
+  paramsGroupHandle_t pgPinger = paramsRegisterGroup(nullptr,
+    CONFIG_PINGER_PGROUP_ROOT_KEY, CONFIG_PINGER_PGROUP_ROOT_TOPIC, CONFIG_PINGER_PGROUP_ROOT_FRIENDLY);
+
+  paramsSetLimitsU8(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_COUNT_KEY, CONFIG_PINGER_PARAM_COUNT_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_pingCount),
+    1, CONFIG_NETPROBE_WINDOW);
+  paramsSetLimitsU16(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U16, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_TIMEOUT_KEY, CONFIG_PINGER_PARAM_TIMEOUT_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_pingTimeout),
+    100, 60000);
+  paramsSetLimitsU8(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_DATASIZE_KEY, CONFIG_PINGER_PARAM_DATASIZE_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_pingPacket),
+    1, NETPROBE_DATA_MAX);
+  paramsSetLimitsU8(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPinger,
+      CONFIG_NETPROBE_PARAM_QUORUM_KEY, CONFIG_NETPROBE_PARAM_QUORUM_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_quorum),
+    1, 3);
+  paramsSetLimitsU8(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_RESULT_MODE_KEY, CONFIG_PINGER_PARAM_RESULT_MODE_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_resultMode),
+    0, 2);
+
+  paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgPinger,
+    CONFIG_PINGER_PARAM_SLOWDOWN_DURATION_KEY, CONFIG_PINGER_PARAM_SLOWDOWN_DURATION_FRIENDLY,
+    CONFIG_MQTT_PARAMS_QOS, (void*)&_maxSlowdownDuration);
+  paramsSetLimitsFloat(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_SLOWDOWN_LOSS_KEY, CONFIG_PINGER_PARAM_SLOWDOWN_LOSS_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_maxSlowdownLoss),
+    0, 100);
+
+  paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgPinger,
+    CONFIG_PINGER_PARAM_UNAVAILABLE_DURATION_KEY, CONFIG_PINGER_PARAM_UNAVAILABLE_DURATION_FRIENDLY,
+    CONFIG_MQTT_PARAMS_QOS, (void*)&_maxUnavailableDuration);
+  paramsSetLimitsFloat(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_UNAVAILABLE_LOSS_KEY, CONFIG_PINGER_PARAM_UNAVAILABLE_LOSS_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_maxUnavailableLoss),
+    0, 100);
+
+  paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgPinger,
+    CONFIG_PINGER_PARAM_UNAVAILABLE_THRESHOLD_KEY, CONFIG_PINGER_PARAM_UNAVAILABLE_THRESHOLD_FRIENDLY,
+    CONFIG_MQTT_PARAMS_QOS, (void*)&_thresholdUnavailable);
+
+  paramsSetLimitsU32(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_INTERVAL_AVAILABLE_KEY, CONFIG_PINGER_PARAM_INTERVAL_AVAILABLE_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_intervalAvailable),
+    1000, 3600000);
+  paramsSetLimitsU32(
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgPinger,
+      CONFIG_PINGER_PARAM_INTERVAL_UNAVAILABLE_KEY, CONFIG_PINGER_PARAM_INTERVAL_UNAVAILABLE_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&_intervalUnavailable),
+    1000, 3600000);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Хосты ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void netprobeHostAdd(const char* hostname, uint16_t id, bool inet,
+  re_ping_event_id_t evid_available, re_ping_event_id_t evid_unavailable, uint32_t limit_unavailable)
+{
+  if (_hostsCount < NETPROBE_HOSTS_MAX) {
+    netprobe_host_t* host = &_hosts[_hostsCount];
+    memset(host, 0, sizeof(netprobe_host_t));
+    host->host_name = hostname;
+    host->id = id;
+    host->inet = inet;
+    host->evid_available = evid_available;
+    host->evid_unavailable = evid_unavailable;
+    host->limit_unavailable = limit_unavailable;
+    host->state = PING_OK;
+    ip_addr_set_zero(&host->host_addr);
+    _hostsCount++;
+  };
+}
+
+#if LWIP_DNS
+// Вызывается из задачи tcpip; arg - номер хоста в младшем байте и поколение запроса в старших
+static void netprobeDnsFound(const char* hostname, const ip_addr_t *ipaddr, void *arg)
+{
+  uint32_t tag = (uint32_t)(uintptr_t)arg;
+  uint8_t index = tag & 0xFF;
+  if (index >= _hostsCount) return;
+  netprobe_host_t* host = &_hosts[index];
+  portENTER_CRITICAL(&_dnsMux);
+  if ((tag >> 8) == (_dnsGeneration & 0xFFFFFF)) {
+    if (ipaddr) {
+      host->host_addr = *ipaddr;
+      host->host_resolved = xTaskGetTickCount();
+    } else {
+      ip_addr_set_zero(&host->host_addr);
+      host->host_resolved = 0;
+    };
+    host->dns_pending = false;
+  };
+  portEXIT_CRITICAL(&_dnsMux);
+}
+#endif // LWIP_DNS
+
+static void netprobeHostSetTarget(netprobe_host_t* host)
+{
+  // Поддерживаются только IPv4 адреса
+  if (!IP_IS_V4(&host->host_addr)) {
+    rlog_w(logTAG, "Host [ %s ] has no IPv4 address", host->host_name);
+    host->host_resolved = 0;
+    return;
+  };
+  memset(&host->target_addr, 0, sizeof(host->target_addr));
+  host->target_addr.sin_family = AF_INET;
+  inet_addr_from_ip4addr(&host->target_addr.sin_addr, ip_2_ip4(&host->host_addr));
+  rlog_d(logTAG, "IP address obtained for hostname [ %s ]: %s", host->host_name, ipaddr_ntoa(&host->host_addr));
+}
+
+// Разрешение имен всех хостов, для которых это требуется, запросы к DNS также выполняются параллельно
+static void netprobeResolveHosts()
+{
+  bool waitDns = false;
+  #if LWIP_DNS
+    uint32_t generation = (_dnsGeneration & 0xFFFFFF) << 8;
+  #endif // LWIP_DNS
+  for (uint8_t i = 0; i < _hostsCount; i++) {
+    netprobe_host_t* host = &_hosts[i];
+    if ((host->received == 0)
+     || (host->host_resolved == 0)
+     || ((xTaskGetTickCount() - host->host_resolved) > pdMS_TO_TICKS(CONFIG_PINGER_IP_VALIDITY))) {
+      host->host_resolved = 0;
+      ip_addr_set_zero(&host->host_addr);
+      #if LWIP_DNS
+        host->dns_pending = true;
+        host->dns_async = false;
+        err_t ret = dns_gethostbyname(host->host_name, &host->host_addr, netprobeDnsFound, (void*)(uintptr_t)(generation | i));
+        if (ret == ERR_OK) {
+          host->dns_pending = false;
+          host->host_resolved = xTaskGetTickCount();
+          netprobeHostSetTarget(host);
+        } else if (ret == ERR_INPROGRESS) {
+          host->dns_async = true;
+          waitDns = true;
+        } else {
+          host->dns_pending = false;
+          rlog_e(logTAG, "Failed to resolve a hostname [ %s ]: %d", host->host_name, ret);
+        };
+      #else
+        if (ipaddr_aton(host->host_name, &host->host_addr)) {
+          host->host_resolved = xTaskGetTickCount();
+          netprobeHostSetTarget(host);
+        };
+      #endif // LWIP_DNS
+    };
+  };
+
+  #if LWIP_DNS
+    // Ожидаем ответы DNS сразу для всех хостов
+    if (waitDns) {
+      TickType_t waitTicks = pdMS_TO_TICKS(10000);
+      bool pending = true;
+      while (pending && (waitTicks > 0)) {
+        vTaskDelay(1);
+        waitTicks--;
+        pending = false;
+        for (uint8_t i = 0; i < _hostsCount; i++) {
+          if (_hosts[i].dns_pending) {
+            pending = true;
+            break;
+          };
+        };
+      };
+      // Закрываем поколение: поздние ответы больше не изменят данные хостов
+      portENTER_CRITICAL(&_dnsMux);
+      _dnsGeneration++;
+      portEXIT_CRITICAL(&_dnsMux);
+      for (uint8_t i = 0; i < _hostsCount; i++) {
+        netprobe_host_t* host = &_hosts[i];
+        if (host->dns_async) {
+          host->dns_async = false;
+          if (host->dns_pending) {
+            host->dns_pending = false;
+            host->host_resolved = 0;
+            rlog_e(logTAG, "Failed to resolve a hostname [ %s ]: DNS TIMEOUT", host->host_name);
+          } else if (host->host_resolved) {
+            netprobeHostSetTarget(host);
+          } else {
+            rlog_e(logTAG, "Failed to resolve a hostname [ %s ]", host->host_name);
+          };
+        };
+      };
+    };
+  #endif // LWIP_DNS
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Сокет ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Один "сырой" сокет на все хосты: ответы различаются по идентификатору ICMP
+static bool netprobeSocketOpen()
+{
+  if (_sock < 0) {
+    _sock = lwip_socket(AF_INET, SOCK_RAW, IP_PROTO_ICMP);
+    if (_sock < 0) {
+      rlog_e(logTAG, "Create socket failed: %d", _sock);
+      return false;
+    };
+  };
+  return true;
+}
+
+static void netprobeSocketClose()
+{
+  if (_sock >= 0) {
+    lwip_close(_sock);
+    _sock = -1;
+  };
+}
+
+static bool netprobeSend(netprobe_host_t* host)
+{
+  struct icmp_echo_hdr* hdr = (struct icmp_echo_hdr*)_packet;
+  size_t size = sizeof(struct icmp_echo_hdr) + _pingPacket;
+  host->seqno++;
+  hdr->type = ICMP_ECHO;
+  hdr->code = 0;
+  hdr->id = lwip_htons(host->id);
+  hdr->seqno = lwip_htons(host->seqno);
+  hdr->chksum = 0;
+  hdr->chksum = inet_chksum(hdr, size);
+
+  host->sent_us = esp_timer_get_time();
+  ssize_t sent = lwip_sendto(_sock, _packet, size, 0, (struct sockaddr*)&host->target_addr, sizeof(host->target_addr));
+  if (sent != (ssize_t)size) {
+    rlog_e(logTAG, "Send ICMP to [ %s ] error = %d", host->host_name, errno);
+    return false;
+  };
+  host->transmitted++;
+  host->waiting = true;
+  return true;
+}
+
+// Прием всех ответов, пришедших в сокет, возвращает количество "закрытых" ожиданий
+static uint8_t netprobeReceive()
+{
+  uint8_t ret = 0;
+  char buf[64]; // 64 bytes are enough to cover IP header and ICMP header
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof(from);
+  int len;
+  while ((len = lwip_recvfrom(_sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*)&from, &fromlen)) > 0) {
+    int64_t now = esp_timer_get_time();
+    fromlen = sizeof(from);
+    if (len < (int)(sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr))) continue;
+    struct ip_hdr* iphdr = (struct ip_hdr*)buf;
+    if ((IPH_HL(iphdr) * 4 + sizeof(struct icmp_echo_hdr)) > (size_t)len) continue;
+    struct icmp_echo_hdr* iecho = (struct icmp_echo_hdr*)(buf + (IPH_HL(iphdr) * 4));
+    if (iecho->type != ICMP_ER) continue;
+    uint16_t id = lwip_ntohs(iecho->id);
+    uint16_t seqno = lwip_ntohs(iecho->seqno);
+    for (uint8_t i = 0; i < _hostsCount; i++) {
+      netprobe_host_t* host = &_hosts[i];
+      if ((host->id == id) && host->waiting && (host->seqno == seqno)) {
+        uint32_t rtt = (uint32_t)((now - host->sent_us) / 1000);
+        if (rtt >= NETPROBE_RTT_LOST) rtt = NETPROBE_RTT_LOST - 1;
+        host->round_rtt[host->received] = (uint16_t)rtt;
+        host->received++;
+        host->total_time_ms += rtt;
+        host->ttl = iphdr->_ttl;
+        host->waiting = false;
+        ret++;
+        break;
+      };
+    };
+  };
+  return ret;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Статистика -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void netprobeSort(uint16_t* data, uint8_t count)
+{
+  for (uint8_t i = 1; i < count; i++) {
+    uint16_t value = data[i];
+    int j = i - 1;
+    while ((j >= 0) && (data[j] > value)) {
+      data[j + 1] = data[j];
+      j--;
+    };
+    data[j + 1] = value;
+  };
+}
+
+static void netprobeWindowPush(netprobe_host_t* host, uint16_t rtt)
+{
+  host->window[host->window_index] = rtt;
+  if (++host->window_index >= CONFIG_NETPROBE_WINDOW) host->window_index = 0;
+  if (host->window_count < CONFIG_NETPROBE_WINDOW) host->window_count++;
+}
+
+// Перцентили p50 / p95 и потери по скользящему окну
+static void netprobeWindowStats(netprobe_host_t* host)
+{
+  uint16_t sorted[CONFIG_NETPROBE_WINDOW];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < host->window_count; i++) {
+    if (host->window[i] != NETPROBE_RTT_LOST) {
+      sorted[count++] = host->window[i];
+    };
+  };
+  netprobeSort(sorted, count);
+
+  portENTER_CRITICAL(&_statsMux);
+  if (count > 0) {
+    host->rtt_p50 = sorted[(count - 1) / 2];
+    host->rtt_p95 = sorted[((uint16_t)(count - 1) * 95) / 100];
+  } else {
+    host->rtt_p50 = _pingTimeout;
+    host->rtt_p95 = _pingTimeout;
+  };
+  host->window_loss = host->window_count > 0 ? 100.0f * (host->window_count - count) / host->window_count : 100.0f;
+  portEXIT_CRITICAL(&_statsMux);
+}
+
+bool netprobeStatsAppend(scratch_arena_t* arena, char** json)
+{
+  bool ok = scratchAppendf(arena, json, nullptr, "{");
+  uint8_t count = _hostsCount;
+  for (uint8_t i = 0; ok && (i < count); i++) {
+    portENTER_CRITICAL(&_statsMux);
+    ping_state_t state = _hosts[i].state;
+    uint16_t rtt_p50 = _hosts[i].rtt_p50;
+    uint16_t rtt_p95 = _hosts[i].rtt_p95;
+    float loss = _hosts[i].window_loss;
+    uint8_t samples = _hosts[i].window_count;
+    portEXIT_CRITICAL(&_statsMux);
+    ok = scratchAppendf(arena, json, i > 0 ? "," : nullptr, "\"%s\":{\"state\":%d,\"p50\":%u,\"p95\":%u,\"loss\":%.1f,\"samples\":%u}",
+      _hosts[i].host_name, (int)state, (unsigned)rtt_p50, (unsigned)rtt_p95, loss, (unsigned)samples);
+  };
+  return ok && scratchAppendf(arena, json, nullptr, "}");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Раунд проверки -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Все хосты опрашиваются одновременно: на каждый пакет отводится одно общее окно ожидания,
+// поэтому длительность раунда не зависит от количества хостов
+static void netprobeRound()
+{
+  // Имена разрешаются заново, если в прошлом раунде хост не ответил или истек срок валидности адреса
+  netprobeResolveHosts();
+
+  for (uint8_t i = 0; i < _hostsCount; i++) {
+    netprobe_host_t* host = &_hosts[i];
+    host->waiting = false;
+    host->transmitted = 0;
+    host->received = 0;
+    host->total_time_ms = 0;
+  };
+
+  if (!netprobeSocketOpen()) goto done;
+
+  for (uint8_t n = 0; n < _pingCount; n++) {
+    // Отправляем очередной пакет на все хосты
+    uint8_t pending = 0;
+    for (uint8_t i = 0; i < _hostsCount; i++) {
+      if (_hosts[i].host_resolved && netprobeSend(&_hosts[i])) {
+        pending++;
+      };
+    };
+    if (pending == 0) break;
+
+    // Ждем ответы в течение одного окна таймаута
+    int64_t deadline = esp_timer_get_time() + (int64_t)_pingTimeout * 1000;
+    while (pending > 0) {
+      int64_t remaining = deadline - esp_timer_get_time();
+      if (remaining <= 0) break;
+      fd_set rfds;
+      FD_ZERO(&rfds);
+      FD_SET(_sock, &rfds);
+      struct timeval tv;
+      tv.tv_sec = remaining / 1000000;
+      tv.tv_usec = remaining % 1000000;
+      int sel = lwip_select(_sock + 1, &rfds, nullptr, nullptr, &tv);
+      if (sel < 0) {
+        rlog_e(logTAG, "Socket select error = %d", errno);
+        netprobeSocketClose();
+        goto done;
+      };
+      if (sel == 0) break;
+      uint8_t closed = netprobeReceive();
+      pending = (closed < pending) ? pending - closed : 0;
+    };
+
+    // Неотвеченные пакеты считаются потерянными
+    for (uint8_t i = 0; i < _hostsCount; i++) {
+      netprobe_host_t* host = &_hosts[i];
+      if (host->waiting) {
+        host->waiting = false;
+        netprobeWindowPush(host, NETPROBE_RTT_LOST);
+      } else if ((host->received > 0) && (host->transmitted == (uint32_t)(n + 1))) {
+        netprobeWindowPush(host, host->round_rtt[host->received - 1]);
+      };
+    };
+  };
+
+  #if CONFIG_PING_KEEP_SOCKET == 0
+    netprobeSocketClose();
+  #endif // CONFIG_PING_KEEP_SOCKET
+
+done:
+  // Итоги раунда по каждому хосту: медиана RTT раунда и потери
+  for (uint8_t i = 0; i < _hostsCount; i++) {
+    netprobe_host_t* host = &_hosts[i];
+    if (host->transmitted > 0) {
+      host->loss = (float)((1 - ((float)host->received) / host->transmitted) * 100);
+      if (host->received > 0) {
+        netprobeSort(host->round_rtt, host->received);
+        host->duration_ms = host->round_rtt[(host->received - 1) / 2];
+        host->state = PING_OK;
+      } else {
+        host->duration_ms = _pingTimeout;
+        host->state = PING_UNAVAILABLE;
+      };
+    } else {
+      host->duration_ms = _pingTimeout;
+      host->loss = 100.0;
+      host->state = PING_FAILED;
+    };
+    netprobeWindowStats(host);
+    rlog_d(logTAG, "Ping statistics for [%s : %s]: %d packets transmitted, %d received, %.1f% % packet loss, median time %d ms; window: p50 %d ms, p95 %d ms, loss %.1f% %",
+      host->host_name, ipaddr_ntoa(&host->host_addr), host->transmitted, host->received, host->loss, host->duration_ms,
+      host->rtt_p50, host->rtt_p95, host->window_loss);
+  };
+}
+
+static void netprobeCopyHostData(netprobe_host_t* host, ping_host_data_t* host_data)
+{
+  memset(host_data, 0, sizeof(ping_host_data_t));
+  host_data->host_name = host->host_name;
+  host_data->host_addr = host->host_addr;
+  host_data->transmitted = host->transmitted;
+  host_data->received = host->received;
+  host_data->total_time_ms = host->total_time_ms;
+  host_data->duration_ms = host->duration_ms;
+  host_data->loss = host->loss;
+  host_data->ttl = host->ttl;
+  host_data->state = host->state;
+}
+
+// События доступности отдельного хоста (с учетом лимита последовательных ошибок)
+static void netprobeHostEvents(netprobe_host_t* host)
+{
+  ping_host_data_t host_data;
+  netprobeCopyHostData(host, &host_data);
+  if (host->state == PING_OK) {
+    if (host->notify_unavailable || (host->count_unavailable > 0)) {
+      rlog_i(logTAG, "Host [ %s ] is available", host->host_name);
+      host_data.time_unavailable = host->time_unavailable;
+      host->count_unavailable = 0;
+      host->time_unavailable = 0;
+      if (host->notify_unavailable) {
+        host->notify_unavailable = false;
+        eventLoopPost(RE_PING_EVENTS, host->evid_available, &host_data, sizeof(host_data), portMAX_DELAY);
+      };
+    };
+  } else {
+    if (host->time_unavailable == 0) {
+      host->time_unavailable = time(nullptr);
+    };
+    host->count_unavailable++;
+    rlog_w(logTAG, "Host [ %s ] is not available (count=%d)", host->host_name, host->count_unavailable);
+    if ((!host->notify_unavailable) && (host->count_unavailable >= host->limit_unavailable)) {
+      host->notify_unavailable = true;
+      host_data.time_unavailable = host->time_unavailable;
+      eventLoopPost(RE_PING_EVENTS, host->evid_unavailable, &host_data, sizeof(host_data), portMAX_DELAY);
+    };
+  };
+}
+
+// Хост a лучше хоста b: меньше потери, при равных потерях - меньше задержка
+static bool netprobeBetter(const netprobe_host_t* a, const netprobe_host_t* b)
+{
+  if (a->loss != b->loss) return a->loss < b->loss;
+  return a->duration_ms < b->duration_ms;
+}
+
+// Итоговая оценка по кворуму: результат определяется по quorum лучшим из доступных хостов, если их меньше -
+// доступа нет. Режим result_mode (как в rePinger) задает, как из них получить итоговое значение:
+// 0 - лучший хост, 1 - среднее по хостам кворума, 2 - худший из хостов кворума (quorum-й лучший).
+// Сортируются записи хостов целиком, поэтому задержка и потери в режимах 0 и 2 всегда относятся к одному хосту
+static void netprobeQuorum(ping_inet_data_t* inet)
+{
+  const netprobe_host_t* ranked[NETPROBE_HOSTS_MAX];
+  uint8_t available = 0;
+  bool first = true;
+
+  inet->hosts_available = 0;
+  inet->duration_ms_min = 0;
+  inet->duration_ms_max = 0;
+  inet->duration_ms_total = _pingTimeout;
+  inet->loss_min = 0;
+  inet->loss_max = 0;
+  inet->loss_total = 100.0;
+
+  for (uint8_t i = 0; i < _hostsCount; i++) {
+    netprobe_host_t* host = &_hosts[i];
+    if (host->inet) {
+      if (first || (host->duration_ms < inet->duration_ms_min)) inet->duration_ms_min = host->duration_ms;
+      if (first || (host->duration_ms > inet->duration_ms_max)) inet->duration_ms_max = host->duration_ms;
+      if (first || (host->loss < inet->loss_min)) inet->loss_min = host->loss;
+      if (first || (host->loss > inet->loss_max)) inet->loss_max = host->loss;
+      first = false;
+      if (host->state == PING_OK) {
+        // Вставка с сохранением порядка от лучшего к худшему
+        int j = available - 1;
+        while ((j >= 0) && netprobeBetter(host, ranked[j])) {
+          ranked[j + 1] = ranked[j];
+          j--;
+        };
+        ranked[j + 1] = host;
+        available++;
+      };
+    };
+  };
+  inet->hosts_available = available;
+
+  uint8_t quorum = _quorum;
+  if (quorum > inet->hosts_count) quorum = inet->hosts_count;
+  if (quorum == 0) quorum = 1;
+  if (available >= quorum) {
+    if (_resultMode == 0) {
+      inet->duration_ms_total = ranked[0]->duration_ms;
+      inet->loss_total = ranked[0]->loss;
+    } else if (_resultMode == 2) {
+      inet->duration_ms_total = ranked[quorum - 1]->duration_ms;
+      inet->loss_total = ranked[quorum - 1]->loss;
+    } else {
+      uint32_t sumDuration = 0;
+      float sumLoss = 0;
+      for (uint8_t i = 0; i < quorum; i++) {
+        sumDuration += ranked[i]->duration_ms;
+        sumLoss += ranked[i]->loss;
+      };
+      inet->duration_ms_total = (uint16_t)(sumDuration / quorum);
+      inet->loss_total = sumLoss / quorum;
+    };
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Задача -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#define LOGMSG_SERVICE_STARTED "Service access check Internet access was started"
+#define LOGMSG_SERVICE_STOPPED "Service access check Internet access was stopped"
+
+static void netprobeExec(void *args)
+{
+  static ping_publish_data_t data;
+  memset(&data, 0, sizeof(data));
+  data.inet.state = PING_FAILED;
+  data.inet.time_unavailable = 0;
+  bool probeEnabled = true;
+  bool probeLastOk = true;
+  uint32_t waitFlags = 0;
+  TickType_t lastCheck = 0;
+  TickType_t waitTicks = 0;
+  ping_state_t inet_state;
+
+  netprobeParamsRegister();
+
+  #ifdef CONFIG_PINGER_HOST_1
+    netprobeHostAdd(CONFIG_PINGER_HOST_1, 7001, true, RE_PING_HOST_AVAILABLE, RE_PING_HOST_UNAVAILABLE, 1);
+    data.inet.hosts_count++;
+  #endif // CONFIG_PINGER_HOST_1
+  #ifdef CONFIG_PINGER_HOST_2
+    netprobeHostAdd(CONFIG_PINGER_HOST_2, 7002, true, RE_PING_HOST_AVAILABLE, RE_PING_HOST_UNAVAILABLE, 1);
+    data.inet.hosts_count++;
+  #endif // CONFIG_PINGER_HOST_2
+  #ifdef CONFIG_PINGER_HOST_3
+    netprobeHostAdd(CONFIG_PINGER_HOST_3, 7003, true, RE_PING_HOST_AVAILABLE, RE_PING_HOST_UNAVAILABLE, 1);
+    data.inet.hosts_count++;
+  #endif // CONFIG_PINGER_HOST_3
+  #if defined(CONFIG_MQTT1_TYPE) && CONFIG_MQTT1_PING_CHECK
+    netprobeHostAdd(CONFIG_MQTT1_HOST, 8101, false, RE_PING_MQTT1_AVAILABLE, RE_PING_MQTT1_UNAVAILABLE, CONFIG_MQTT1_PING_CHECK_LIMIT);
+  #endif // CONFIG_MQTT1_PING_CHECK
+  #if defined(CONFIG_MQTT2_TYPE) && CONFIG_MQTT2_PING_CHECK
+    netprobeHostAdd(CONFIG_MQTT2_HOST, 8102, false, RE_PING_MQTT2_AVAILABLE, RE_PING_MQTT2_UNAVAILABLE, CONFIG_MQTT2_PING_CHECK_LIMIT);
+  #endif // CONFIG_MQTT2_PING_CHECK
+
+  #if CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+    pingerOpenMonInit();
+  #endif // CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+
+  rlog_i(logTAG, LOGMSG_SERVICE_STARTED);
+  eventLoopPost(RE_PING_EVENTS, RE_PING_STARTED, nullptr, 0, portMAX_DELAY);
+
+  while (1) {
+    // Ожидание уведомлений о запуске или остановке проверки
+    if (xTaskNotifyWait(0, ULONG_MAX, &waitFlags, waitTicks) == pdPASS) {
+      if ((waitFlags & PROBE_START) == PROBE_START) {
+        if (!probeEnabled) {
+          probeEnabled = true;
+          rlog_i(logTAG, LOGMSG_SERVICE_STARTED);
+          eventLoopPost(RE_PING_EVENTS, RE_PING_STARTED, nullptr, 0, portMAX_DELAY);
+          data.inet.state = PING_FAILED;
+        };
+      } else if ((waitFlags & PROBE_STOP) == PROBE_STOP) {
+        if (probeEnabled) {
+          probeEnabled = false;
+          netprobeSocketClose();
+          rlog_i(logTAG, LOGMSG_SERVICE_STOPPED);
+          eventLoopPost(RE_PING_EVENTS, RE_PING_STOPPED, nullptr, 0, portMAX_DELAY);
+        };
+        waitTicks = portMAX_DELAY;
+      };
+    };
+
+    if (probeEnabled) {
+      rlog_i(logTAG, "Internet access is checked...");
+      lastCheck = xTaskGetTickCount();
+
+      // Параллельный опрос всех хостов
+      netprobeRound();
+
+      // События по отдельным хостам интернета и итоговая оценка по кворуму
+      uint8_t hostIndex = 0;
+      for (uint8_t i = 0; i < _hostsCount; i++) {
+        if (_hosts[i].inet) {
+          netprobeHostEvents(&_hosts[i]);
+          #ifdef CONFIG_PINGER_HOST_1
+            if (hostIndex == 0) netprobeCopyHostData(&_hosts[i], &data.host1);
+          #endif // CONFIG_PINGER_HOST_1
+          #ifdef CONFIG_PINGER_HOST_2
+            if (hostIndex == 1) netprobeCopyHostData(&_hosts[i], &data.host2);
+          #endif // CONFIG_PINGER_HOST_2
+          #ifdef CONFIG_PINGER_HOST_3
+            if (hostIndex == 2) netprobeCopyHostData(&_hosts[i], &data.host3);
+          #endif // CONFIG_PINGER_HOST_3
+          hostIndex++;
+        };
+      };
+      netprobeQuorum(&data.inet);
+      probeLastOk = ((data.inet.hosts_available > 0) && (data.inet.duration_ms_total < _maxSlowdownDuration) && (data.inet.loss_total < _maxSlowdownLoss));
+
+      // Анализ результатов и отправка событий
+      if ((data.inet.hosts_available > 0) && (data.inet.duration_ms_total < _maxUnavailableDuration) && (data.inet.loss_total <= _maxUnavailableLoss)) {
+        if ((data.inet.duration_ms_total < _maxSlowdownDuration) && (data.inet.loss_total < _maxSlowdownLoss)) {
+          inet_state = PING_OK;
+          rlog_i(logTAG, "Internet access is available (%d ms, %d of %d hosts)", data.inet.duration_ms_total, data.inet.hosts_available, data.inet.hosts_count);
+          if (data.inet.state != inet_state) {
+            data.inet.state = inet_state;
+            eventLoopPost(RE_PING_EVENTS, RE_PING_INET_AVAILABLE, &data.inet, sizeof(data.inet), portMAX_DELAY);
+            data.inet.time_unavailable = 0;
+          };
+        } else {
+          inet_state = PING_SLOWDOWN;
+          rlog_w(logTAG, "Internet access is slowed (%d ms, %d of %d hosts)", data.inet.duration_ms_total, data.inet.hosts_available, data.inet.hosts_count);
+          if (data.inet.state != inet_state) {
+            if (data.inet.time_unavailable == 0) {
+              data.inet.time_unavailable = time(nullptr);
+            };
+            data.inet.state = inet_state;
+            eventLoopPost(RE_PING_EVENTS, RE_PING_INET_SLOWDOWN, &data.inet, sizeof(data.inet), portMAX_DELAY);
+          };
+        };
+        data.inet.count_unavailable = 0;
+      } else {
+        inet_state = PING_UNAVAILABLE;
+        rlog_e(logTAG, "Internet access is not available! (%d of %d hosts)", data.inet.hosts_available, data.inet.hosts_count);
+        if (data.inet.state != inet_state) {
+          data.inet.count_unavailable++;
+          if ((data.inet.state <= PING_UNAVAILABLE) || (data.inet.time_unavailable == 0)) {
+            data.inet.time_unavailable = time(nullptr);
+          };
+          if ((data.inet.state == PING_OK) || (data.inet.state == PING_SLOWDOWN)) {
+            if (data.inet.count_unavailable >= _thresholdUnavailable) {
+              data.inet.state = PING_UNAVAILABLE;
+              eventLoopPost(RE_PING_EVENTS, RE_PING_INET_UNAVAILABLE, &data.inet, sizeof(data.inet), portMAX_DELAY);
+            };
+          } else {
+            data.inet.state = PING_UNAVAILABLE;
+          };
+        };
+      };
+
+      // Публикация результатов
+      #if CONFIG_MQTT_PINGER_ENABLE
+        pingerMqttPublish(&data);
+      #endif // CONFIG_MQTT_PINGER_ENABLE
+      #if CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+        pingerOpenMonPublish(&data);
+      #endif // CONFIG_OPENMON_ENABLE && CONFIG_OPENMON_PINGER_ENABLE
+
+      // Хосты MQTT-брокеров проверяются в том же раунде, но события по ним отправляются только при наличии интернета
+      if (probeLastOk) {
+        for (uint8_t i = 0; i < _hostsCount; i++) {
+          if (!_hosts[i].inet) {
+            netprobeHostEvents(&_hosts[i]);
+          };
+        };
+      };
+
+      // Интервал до следующей проверки
+      if (probeLastOk) {
+        waitTicks = (xTaskGetTickCount() - lastCheck);
+        if (pdMS_TO_TICKS(_intervalAvailable) > waitTicks) {
+          waitTicks = pdMS_TO_TICKS(_intervalAvailable) - waitTicks;
+        } else {
+          waitTicks = 1;
+        };
+      } else {
+        waitTicks = pdMS_TO_TICKS(_intervalUnavailable);
+      };
+    };
+  };
+
+  netprobeSocketClose();
+  vTaskDelete(NULL);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Task routines ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool netprobeTaskCreate(bool createSuspended)
+{
+  if (!_netprobeTask) {
+    #if CONFIG_PINGER_TASK_STATIC_ALLOCATION
+      _netprobeTask = xTaskCreateStaticPinnedToCore(netprobeExec, netprobeTaskName,
+        CONFIG_PINGER_TASK_STACK_SIZE, NULL, CONFIG_TASK_PRIORITY_PINGER,
+        _netprobeTaskStack, &_netprobeTaskBuffer,
+        CONFIG_TASK_CORE_PINGER);
+    #else
+      xTaskCreatePinnedToCore(netprobeExec, netprobeTaskName,
+        CONFIG_PINGER_TASK_STACK_SIZE, NULL, CONFIG_TASK_PRIORITY_PINGER,
+        &_netprobeTask,
+        CONFIG_TASK_CORE_PINGER);
+    #endif // CONFIG_PINGER_TASK_STATIC_ALLOCATION
+    if (_netprobeTask) {
+      if (createSuspended) {
+        rloga_i("Task [ %s ] has been successfully created", netprobeTaskName);
+        netprobeTaskSuspend();
+      } else {
+        rloga_i("Task [ %s ] has been successfully started", netprobeTaskName);
+      };
+      return true;
+    } else {
+      rloga_e("Failed to create task for Internet checking!");
+      eventLoopPostError(RE_SYS_ERROR, ESP_FAIL);
+      return false;
+    };
+  };
+  return false;
+}
+
+bool netprobeTaskSuspend()
+{
+  if ((_netprobeTask) && (eTaskGetState(_netprobeTask) != eSuspended)) {
+    vTaskSuspend(_netprobeTask);
+    if (eTaskGetState(_netprobeTask) == eSuspended) {
+      rloga_d("Task [ %s ] has been suspended", netprobeTaskName);
+      return true;
+    } else {
+      rloga_e("Failed to suspend task [ %s ]", netprobeTaskName);
+    };
+  };
+  return false;
+}
+
+bool netprobeTaskResume()
+{
+  if ((_netprobeTask) && (eTaskGetState(_netprobeTask) == eSuspended)) {
+    vTaskResume(_netprobeTask);
+    if (eTaskGetState(_netprobeTask) != eSuspended) {
+      rloga_i("Task [ %s ] has been successfully resumed", netprobeTaskName);
+      return true;
+    } else {
+      rloga_e("Failed to resume task [ %s ]", netprobeTaskName);
+    };
+  };
+  return false;
+}
+
+bool netprobeTaskDelete()
+{
+  if (_netprobeTask) {
+    vTaskDelete(_netprobeTask);
+    _netprobeTask = nullptr;
+    netprobeSocketClose();
+    rloga_d("Task [ %s ] was deleted", netprobeTaskName);
+  };
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Event handlers ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void netprobeWifiEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if (event_id == RE_WIFI_STA_GOT_IP) {
+    if (_netprobeTask) {
+      netprobeTaskResume();
+    } else {
+      netprobeTaskCreate(false);
+    };
+    if (_netprobeTask) {
+      xTaskNotify(_netprobeTask, PROBE_START, eSetBits);
+    };
+  } else if ((event_id == RE_WIFI_STA_DISCONNECTED) || (event_id == RE_WIFI_STA_STOPPED)) {
+    if ((_netprobeTask) && (eTaskGetState(_netprobeTask) != eSuspended)) {
+      xTaskNotify(_netprobeTask, PROBE_STOP, eSetBits);
+    };
+  };
+}
+
+static void netprobeOtaEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if ((event_id == RE_SYS_OTA) && (event_data)) {
+    re_system_event_data_t* data = (re_system_event_data_t*)event_data;
+    if (data->type == RE_SYS_SET) {
+      netprobeTaskSuspend();
+    } else {
+      netprobeTaskResume();
+    };
+  };
+}
+
+bool netprobeEventHandlerRegister()
+{
+  rlog_d(logTAG, "Register netprobe event handlers...");
+  perfSectionRegister("netprobe", netprobeStatsAppend);
+  bool ret = eventHandlerRegister(RE_WIFI_EVENTS, ESP_EVENT_ANY_ID, &netprobeWifiEventHandler, nullptr);
+  ret = ret && eventHandlerRegister(RE_SYSTEM_EVENTS, RE_SYS_OTA, &netprobeOtaEventHandler, nullptr);
+  #if CONFIG_MQTT_PINGER_ENABLE
+    ret = ret && pingerMqttRegister();
+  #endif // CONFIG_MQTT_PINGER_ENABLE
+  return ret;
+}
+
+#endif // CONFIG_PINGER_ENABLE && CONFIG_NETPROBE_ENABLE
@@ -0,0 +1,38 @@
+/*
+   Модуль параллельной проверки доступа в сеть интернет: ICMP-запросы отправляются сразу на все хосты
+   и ожидаются в одном общем окне таймаута, итоговое состояние определяется по кворуму хостов.
+   RTT (p50 / p95) и потери по каждому хосту публикуются в составе метрик производительности (perfstat, раздел "netprobe")
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __NETPROBE_H__
+#define __NETPROBE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "project_config.h"
+#include "def_consts.h"
+#include "reEvents.h"
+#include "scratch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool netprobeTaskCreate(bool createSuspended);
+bool netprobeTaskSuspend();
+bool netprobeTaskResume();
+bool netprobeTaskDelete();
+
+// Статистика всех хостов по скользящему окну последних CONFIG_NETPROBE_WINDOW пакетов в формате JSON
+bool netprobeStatsAppend(scratch_arena_t* arena, char** json);
+
+bool netprobeEventHandlerRegister();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NETPROBE_H__
@@ -0,0 +1,323 @@
+#include "otaresume.h"
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_http_client.h"
+#include "esp_idf_version.h"
+#include "def_consts.h"
+#include "def_tasks.h"
+#include "rLog.h"
+#include "rStrings.h"
+#include "reEsp32.h"
+#include "reEvents.h"
+#if CONFIG_TELEGRAM_ENABLE
+#include "reTgSend.h"
+#endif // CONFIG_TELEGRAM_ENABLE
+#if CONFIG_OTA_PEM_STORAGE == TLS_CERT_BUNDLE
+#include "esp_crt_bundle.h"
+#endif // CONFIG_OTA_PEM_STORAGE
+
+static const char* logTAG = "OTA";
+static const char* otaTaskName = "ota";
+static TaskHandle_t _otaTask = nullptr;
+
+#if CONFIG_OTA_PEM_STORAGE == TLS_CERT_BUFFER
+  extern const char ota_pem_start[]  asm(CONFIG_OTA_PEM_START);
+  extern const char ota_pem_end[]    asm(CONFIG_OTA_PEM_END);
+#endif // CONFIG_OTA_PEM_STORAGE
+
+typedef struct {
+  const esp_partition_t* target;
+  esp_ota_handle_t handle;
+  bool     begun;           // Запись в раздел начата (esp_ota_begin() выполнен)
+  uint32_t received;        // Получено и записано байт (позиция для докачки)
+  uint32_t total;           // Размер файла по данным сервера (0 - пока неизвестен)
+  bool     complete;        // Сервер подтвердил, что файл получен полностью
+} ota_stream_t;
+
+// Запись в раздел начинается с первыми данными, когда размер образа уже известен из заголовков ответа:
+// esp_ota_begin() стирает только занятые образом секторы, а не весь раздел
+static esp_err_t otaStreamFeed(ota_stream_t* ota, const uint8_t* data, size_t size)
+{
+  if (!ota->begun) {
+    if (ota->total > ota->target->size) {
+      rlog_e(logTAG, "Firmware size %d exceeds partition size %d", ota->total, ota->target->size);
+      return ESP_ERR_INVALID_SIZE;
+    };
+    esp_err_t err = esp_ota_begin(ota->target, ota->total > 0 ? ota->total : OTA_SIZE_UNKNOWN, &ota->handle);
+    if (err != ESP_OK) {
+      rlog_e(logTAG, "Failed to begin OTA: %d %s", err, esp_err_to_name(err));
+      return err;
+    };
+    ota->begun = true;
+  };
+  esp_err_t err = esp_ota_write(ota->handle, data, size);
+  if (err == ESP_OK) {
+    ota->received += size;
+  };
+  return err;
+}
+
+// Content-Range: "bytes <start>-<end>/<total>" для 206 или "bytes */<total>" для 416.
+// Возвращает true, если заголовок разобран; start = UINT32_MAX для формы "*"
+static bool otaParseContentRange(esp_http_client_handle_t client, uint32_t* start, uint32_t* total)
+{
+  char* value = nullptr;
+  if ((esp_http_client_get_header(client, "Content-Range", &value) != ESP_OK) || (value == nullptr)) {
+    return false;
+  };
+  unsigned long s = 0, e = 0, t = 0;
+  if (sscanf(value, "bytes %lu-%lu/%lu", &s, &e, &t) == 3) {
+    *start = s;
+    *total = t;
+    return true;
+  };
+  if (sscanf(value, "bytes */%lu", &t) == 1) {
+    *start = UINT32_MAX;
+    *total = t;
+    return true;
+  };
+  return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Загрузка -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Одна попытка загрузки с текущей позиции потока, обрыв соединения до конца файла - ESP_ERR_TIMEOUT
+static esp_err_t otaDownload(const char* otaSource, ota_stream_t* ota, uint8_t* buf)
+{
+  esp_http_client_config_t cfgHTTP;
+  memset(&cfgHTTP, 0, sizeof(cfgHTTP));
+  cfgHTTP.url = otaSource;
+  cfgHTTP.skip_cert_common_name_check = false;
+  cfgHTTP.keep_alive_enable = true;
+  #if CONFIG_OTA_PEM_STORAGE == TLS_CERT_BUFFER
+    cfgHTTP.use_global_ca_store = false;
+    cfgHTTP.cert_pem = ota_pem_start;
+  #elif CONFIG_OTA_PEM_STORAGE == TLS_CERT_GLOBAL
+    cfgHTTP.use_global_ca_store = true;
+  #elif CONFIG_OTA_PEM_STORAGE == TLS_CERT_BUNDLE
+    cfgHTTP.use_global_ca_store = false;
+    cfgHTTP.crt_bundle_attach = esp_crt_bundle_attach;
+  #endif // CONFIG_OTA_PEM_STORAGE
+
+  esp_http_client_handle_t client = esp_http_client_init(&cfgHTTP);
+  if (client == nullptr) return ESP_ERR_NO_MEM;
+
+  // Докачка с последнего полученного байта
+  char* range = nullptr;
+  if (ota->received > 0) {
+    range = malloc_stringf("bytes=%d-", ota->received);
+    if (range) {
+      esp_http_client_set_header(client, "Range", range);
+    };
+  };
+
+  esp_err_t err = esp_http_client_open(client, 0);
+  if (err == ESP_OK) {
+    int64_t length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+    uint32_t skip = 0;
+    uint32_t start = 0;
+    uint32_t total = 0;
+    if (status == 200) {
+      // Полный файл: если сервер не поддерживает Range, пропускаем уже полученную часть
+      if (length > 0) {
+        ota->total = (uint32_t)length;
+      };
+      if (ota->received > 0) {
+        rlog_w(logTAG, "Server does not support range requests, skipping %d bytes", ota->received);
+        skip = ota->received;
+      };
+    } else if (status == 206) {
+      // Фрагмент принимается, только если он начинается точно с текущей позиции, иначе образ будет испорчен
+      if (!otaParseContentRange(client, &start, &total) || (start != ota->received)) {
+        rlog_e(logTAG, "Partial content does not start at position %d", ota->received);
+        err = ESP_ERR_INVALID_RESPONSE;
+      } else {
+        ota->total = total;
+        rlog_i(logTAG, "Download resumed from %d of %d bytes", ota->received, ota->total);
+      };
+    } else if ((status == 416) && (ota->received > 0)) {
+      // Запрошенная позиция совпадает с размером файла: все данные уже получены при предыдущей попытке
+      if (otaParseContentRange(client, &start, &total) && (total == ota->received)
+       && ((ota->total == 0) || (ota->total == total))) {
+        rlog_i(logTAG, "Firmware already fully received: %d bytes", ota->received);
+        ota->complete = true;
+      } else {
+        rlog_e(logTAG, "Range not satisfiable at position %d", ota->received);
+        err = ESP_ERR_INVALID_SIZE;
+      };
+    } else {
+      rlog_e(logTAG, "HTTP status %d", status);
+      err = ESP_ERR_INVALID_RESPONSE;
+    };
+
+    while ((err == ESP_OK) && !ota->complete) {
+      int len = esp_http_client_read(client, (char*)buf, CONFIG_OTA_RESUME_BUFFER_SIZE);
+      if (len < 0) {
+        err = ESP_FAIL;
+      } else if (len == 0) {
+        if (!esp_http_client_is_complete_data_received(client) || ((ota->total > 0) && (ota->received < ota->total))) {
+          err = ESP_ERR_TIMEOUT;
+        } else {
+          ota->complete = true;
+        };
+        break;
+      } else if (skip > 0) {
+        uint32_t drop = ((uint32_t)len > skip) ? skip : (uint32_t)len;
+        skip -= drop;
+        if ((uint32_t)len > drop) {
+          err = otaStreamFeed(ota, buf + drop, len - drop);
+        };
+      } else {
+        err = otaStreamFeed(ota, buf, len);
+      };
+    };
+  };
+
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+  if (range) free(range);
+  return err;
+}
+
+static esp_err_t otaExecute(const char* otaSource)
+{
+  const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+  if (target == nullptr) {
+    rlog_e(logTAG, "No OTA partition found");
+    return ESP_ERR_NOT_FOUND;
+  };
+
+  ota_stream_t ota;
+  memset(&ota, 0, sizeof(ota));
+  ota.target = target;
+
+  uint8_t* buf = (uint8_t*)malloc(CONFIG_OTA_RESUME_BUFFER_SIZE);
+  if (buf == nullptr) return ESP_ERR_NO_MEM;
+
+  esp_err_t err = ESP_OK;
+  // Попытки считаются только подряд без продвижения: любой полученный байт сбрасывает счетчик
+  uint8_t tryUpdate = 0;
+  do {
+    uint32_t before = ota.received;
+    tryUpdate++;
+    rlog_i(logTAG, "Start of firmware upgrade from \"%s\", attempt %d, position %d", otaSource, tryUpdate, ota.received);
+    err = otaDownload(otaSource, &ota, buf);
+    if (ota.received > before) {
+      tryUpdate = 0;
+    };
+    // Ошибки формата и записи повторять бессмысленно
+    if ((err == ESP_OK) || ((err != ESP_FAIL) && (err != ESP_ERR_TIMEOUT) && (err != ESP_ERR_HTTP_CONNECT)
+      && (err != ESP_ERR_HTTP_FETCH_HEADER) && (err != ESP_ERR_INVALID_RESPONSE))) {
+      break;
+    };
+    rlog_e(logTAG, "Firmware download interrupted at %d bytes: %d %s", ota.received, err, esp_err_to_name(err));
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_DELAY));
+  } while (tryUpdate < CONFIG_OTA_ATTEMPTS);
+  free(buf);
+
+  if ((err == ESP_OK) && (!ota.begun || ((ota.total > 0) && (ota.received != ota.total)))) {
+    rlog_e(logTAG, "Received %d bytes instead of %d", ota.received, ota.total);
+    err = ESP_ERR_INVALID_SIZE;
+  };
+
+  if (err == ESP_OK) {
+    err = esp_ota_end(ota.handle);
+    if (err == ESP_OK) {
+      err = esp_ota_set_boot_partition(target);
+    };
+  } else if (ota.begun) {
+    esp_ota_abort(ota.handle);
+  };
+  return err;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Задача ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void otaTaskExec(void *pvParameters)
+{
+  if (pvParameters) {
+    char* otaSource = (char*)pvParameters;
+
+    #if CONFIG_TELEGRAM_ENABLE && CONFIG_NOTIFY_TELEGRAM_OTA
+      tgSend(MK_SERVICE, CONFIG_NOTIFY_TELEGRAM_OTA_PRIORITY, CONFIG_NOTIFY_TELEGRAM_ALERT_OTA, CONFIG_TELEGRAM_DEVICE,
+        CONFIG_MESSAGE_TG_OTA, otaSource);
+    #endif // CONFIG_TELEGRAM_ENABLE && CONFIG_NOTIFY_TELEGRAM_OTA
+
+    // Notify other tasks to suspend activities
+    eventLoopPostSystem(RE_SYS_OTA, RE_SYS_SET);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_DELAY));
+
+    // Start watchdog timer
+    static re_restart_timer_t otaTimer;
+    espRestartTimerStartS(&otaTimer, RR_OTA_TIMEOUT, CONFIG_OTA_WATCHDOG, true);
+
+    esp_err_t err = otaExecute(otaSource);
+    if (err == ESP_OK) {
+      rlog_i(logTAG, "Firmware upgrade completed!");
+    } else {
+      rlog_e(logTAG, "Firmware upgrade failed: %d %s!", err, esp_err_to_name(err));
+    };
+
+    // Notify other tasks to restore activities
+    eventLoopPostSystem(RE_SYS_OTA, RE_SYS_CLEAR);
+
+    #if CONFIG_TELEGRAM_ENABLE && CONFIG_NOTIFY_TELEGRAM_OTA
+    if (err == ESP_OK) {
+      tgSend(MK_SERVICE, CONFIG_NOTIFY_TELEGRAM_OTA_PRIORITY, CONFIG_NOTIFY_TELEGRAM_ALERT_OTA, CONFIG_TELEGRAM_DEVICE,
+        CONFIG_MESSAGE_TG_OTA_OK, err);
+    } else {
+      tgSend(MK_SERVICE, CONFIG_NOTIFY_TELEGRAM_OTA_PRIORITY, CONFIG_NOTIFY_TELEGRAM_ALERT_OTA, CONFIG_TELEGRAM_DEVICE,
+        CONFIG_MESSAGE_TG_OTA_FAILED, err);
+    };
+    #endif // CONFIG_TELEGRAM_ENABLE && CONFIG_NOTIFY_TELEGRAM_OTA
+
+    // Free resources
+    free(otaSource);
+    _otaTask = nullptr;
+
+    // Stop timer
+    if (err == ESP_OK) {
+      espRestartTimerStart(&otaTimer, RR_OTA, CONFIG_OTA_DELAY, true);
+    } else {
+      espRestartTimerFree(&otaTimer);
+    };
+  };
+
+  vTaskDelete(nullptr);
+}
+
+void otaResumeStart(char *otaSource)
+{
+  if (otaSource) {
+    if (_otaTask == nullptr) {
+      xTaskCreatePinnedToCore(otaTaskExec, otaTaskName, CONFIG_OTA_TASK_STACK_SIZE, (void*)otaSource, CONFIG_TASK_PRIORITY_OTA, &_otaTask, CONFIG_TASK_CORE_OTA);
+      if (_otaTask) {
+        rloga_i("Task [ %s ] has been successfully created and started", otaTaskName);
+      }
+      else {
+        rloga_e("Failed to create a task for OTA update!");
+        free(otaSource);
+      };
+    } else {
+      rloga_e("OTA update has already started!");
+      free(otaSource);
+    };
+  } else {
+    rlog_e(logTAG, "Update source not specified");
+  };
+}
+
+// Подмена otaStart() из reOTA (см. -Wl,--wrap=otaStart в CMakeLists.txt)
+extern "C" void __wrap_otaStart(char *otaSource)
+{
+  otaResumeStart(otaSource);
+}
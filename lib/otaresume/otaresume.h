@@ -0,0 +1,39 @@
+/*
+   Модуль OTA обновления с докачкой.
+   При обрыве соединения загрузка продолжается с последнего записанного байта (HTTP Range), а не начинается заново.
+   Ответ 206 принимается, только если Content-Range начинается точно с этой позиции; ответ 416 на позицию,
+   равную размеру файла, означает, что файл уже получен полностью.
+   Раздел стирается только на размер образа, известный из заголовков первого ответа сервера.
+   Загружаются только полные образы прошивки, бинарные дельта-обновления не поддерживаются.
+
+   Функция otaStart() из reOTA подменяется через ключ компоновщика -Wl,--wrap=otaStart
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __OTARESUME_H__
+#define __OTARESUME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "project_config.h"
+
+#ifndef CONFIG_OTA_RESUME_BUFFER_SIZE
+#define CONFIG_OTA_RESUME_BUFFER_SIZE 1024
+#endif // CONFIG_OTA_RESUME_BUFFER_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Запуск обновления из otaSource (строка освобождается модулем)
+ * */
+void otaResumeStart(char *otaSource);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OTARESUME_H__
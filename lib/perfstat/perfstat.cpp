@@ -0,0 +1,471 @@
+#include "perfstat.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "rLog.h"
+#include "rStrings.h"
+#include "reEvents.h"
+#include "reStates.h"
+#include "reMqtt.h"
+#include "reEsp32.h"
+#include "scratch.h"
+#include "def_consts.h"
+
+extern "C" esp_err_t __real_mqttPublish(char *topic, char *payload, int qos, bool retained, bool free_topic, bool free_payload);
+extern "C" BaseType_t __real_xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, 
+  TickType_t xTicksToWait, const BaseType_t xCopyPosition);
+extern "C" BaseType_t __real_xQueueGenericSendFromISR(QueueHandle_t xQueue, const void * const pvItemToQueue, 
+  BaseType_t * const pxHigherPriorityTaskWoken, const BaseType_t xCopyPosition);
+
+#if CONFIG_PERFSTAT_ENABLE
+
+static const char* logTAG = "PERF";
+
+// 4 интервала на октаву: 0..3 мкс точно, далее [4..7] << (octave-2)
+#define PERFSTAT_SUBBITS  2
+#define PERFSTAT_SUBS     (1 << PERFSTAT_SUBBITS)
+#define PERFSTAT_OCTAVES  24
+#define PERFSTAT_BUCKETS  (PERFSTAT_OCTAVES * PERFSTAT_SUBS)
+
+typedef struct {
+  const char* name;
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
+  int64_t mark;
+  uint16_t buckets[PERFSTAT_BUCKETS];
+} perf_data_t;
+
+static perf_data_t _metrics[CONFIG_PERFSTAT_METRICS];
+// Копии, по которым сформировано последнее сообщение: вычитаются из метрик только после успешной отправки
+static perf_data_t _metricsSent[CONFIG_PERFSTAT_METRICS];
+static uint8_t _metricsCount = 0;
+static portMUX_TYPE _perfMux = portMUX_INITIALIZER_UNLOCKED;
+static perf_metric_t _perfMqttPublish = PERF_METRIC_NONE;
+static char _perfScratchBuf[CONFIG_PERFSTAT_JSON_SIZE];
+static scratch_arena_t _perfScratch = { _perfScratchBuf, sizeof(_perfScratchBuf), 0, 0, 0, nullptr };
+// Топик создается и освобождается в задаче цикла событий, а используется в задаче публикации - только под _perfMux
+static char* _perfTopic = nullptr;
+
+static const char* perfTaskName = "perfstat";
+static TaskHandle_t _perfTask = nullptr;
+static StaticTask_t _perfTaskBuffer;
+static StackType_t _perfTaskStack[CONFIG_PERFSTAT_TASK_STACK_SIZE];
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Гистограмма ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static inline uint8_t perfBucketIndex(uint32_t value)
+{
+  if (value < PERFSTAT_SUBS) return value;
+  uint8_t msb = 31 - __builtin_clz(value);
+  uint32_t index = (msb - PERFSTAT_SUBBITS + 1) * PERFSTAT_SUBS + ((value >> (msb - PERFSTAT_SUBBITS)) & (PERFSTAT_SUBS - 1));
+  return index < PERFSTAT_BUCKETS ? index : PERFSTAT_BUCKETS - 1;
+}
+
+// Середина интервала гистограммы, мкс
+static uint32_t perfBucketValue(uint8_t index)
+{
+  if (index < PERFSTAT_SUBS) return index;
+  uint8_t shift = index / PERFSTAT_SUBS - 1;
+  uint32_t low = (uint32_t)(PERFSTAT_SUBS + index % PERFSTAT_SUBS) << shift;
+  return low + ((1UL << shift) >> 1);
+}
+
+static uint32_t perfPercentile(const perf_data_t* data, uint32_t total, uint8_t percents)
+{
+  if (total == 0) return 0;
+  uint32_t target = (total * percents + 99) / 100;
+  uint32_t summary = 0;
+  for (uint8_t i = 0; i < PERFSTAT_BUCKETS; i++) {
+    summary += data->buckets[i];
+    if (summary >= target) {
+      uint32_t value = perfBucketValue(i);
+      return value < data->max ? value : data->max;
+    };
+  };
+  return data->max;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Метрики ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+perf_metric_t perfRegister(const char* name)
+{
+  perf_metric_t ret = PERF_METRIC_NONE;
+  portENTER_CRITICAL(&_perfMux);
+  for (uint8_t i = 0; i < _metricsCount; i++) {
+    if (strcmp(_metrics[i].name, name) == 0) {
+      ret = i;
+      break;
+    };
+  };
+  if ((ret == PERF_METRIC_NONE) && (_metricsCount < CONFIG_PERFSTAT_METRICS)) {
+    memset(&_metrics[_metricsCount], 0, sizeof(perf_data_t));
+    _metrics[_metricsCount].name = name;
+    ret = _metricsCount++;
+  };
+  portEXIT_CRITICAL(&_perfMux);
+  if (ret == PERF_METRIC_NONE) {
+    rlog_e(logTAG, "Failed to register metric [ %s ]: too many metrics", name);
+  };
+  return ret;
+}
+
+void perfRecord(perf_metric_t metric, uint32_t duration_us)
+{
+  if ((metric < 0) || (metric >= _metricsCount)) return;
+  uint8_t index = perfBucketIndex(duration_us);
+  portENTER_CRITICAL_SAFE(&_perfMux);
+  perf_data_t* data = &_metrics[metric];
+  data->count++;
+  data->sum += duration_us;
+  if (duration_us > data->max) data->max = duration_us;
+  if (data->buckets[index] < UINT16_MAX) data->buckets[index]++;
+  portEXIT_CRITICAL_SAFE(&_perfMux);
+}
+
+void perfMarkSet(perf_metric_t metric)
+{
+  if ((metric < 0) || (metric >= _metricsCount)) return;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_SAFE(&_perfMux);
+  _metrics[metric].mark = now;
+  portEXIT_CRITICAL_SAFE(&_perfMux);
+}
+
+void perfMarkRecord(perf_metric_t metric, uint32_t max_age_us)
+{
+  if ((metric < 0) || (metric >= _metricsCount)) return;
+  int64_t now = esp_timer_get_time();
+  int64_t mark = 0;
+  portENTER_CRITICAL_SAFE(&_perfMux);
+  mark = _metrics[metric].mark;
+  _metrics[metric].mark = 0;
+  portEXIT_CRITICAL_SAFE(&_perfMux);
+  if ((mark > 0) && (now - mark <= max_age_us)) {
+    perfRecord(metric, (uint32_t)(now - mark));
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Очереди и куча ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  const char* name;
+  QueueHandle_t queue;
+  UBaseType_t size;
+  UBaseType_t peak;     // Максимальное заполнение за интервал
+  UBaseType_t full;     // Количество отправок, отклоненных из-за заполнения очереди
+} perf_queue_t;
+
+static perf_queue_t _queues[CONFIG_PERFSTAT_QUEUES];
+static perf_queue_t _queuesSent[CONFIG_PERFSTAT_QUEUES];
+static uint8_t _queuesCount = 0;
+
+bool perfQueueRegister(const char* name, QueueHandle_t queue)
+{
+  if (queue == nullptr) return false;
+  bool ret = false;
+  portENTER_CRITICAL(&_perfMux);
+  if (_queuesCount < CONFIG_PERFSTAT_QUEUES) {
+    _queues[_queuesCount].name = name;
+    _queues[_queuesCount].queue = queue;
+    _queues[_queuesCount].size = uxQueueMessagesWaiting(queue) + uxQueueSpacesAvailable(queue);
+    _queues[_queuesCount].peak = 0;
+    _queues[_queuesCount].full = 0;
+    _queuesCount++;
+    ret = true;
+  };
+  portEXIT_CRITICAL(&_perfMux);
+  if (!ret) {
+    rlog_e(logTAG, "Failed to register queue [ %s ]: too many queues", name);
+  };
+  return ret;
+}
+
+// Вызывается из подмены xQueueGenericSend() для любой очереди и семафора, поэтому сначала дешевый поиск по списку.
+// Заполнение фиксируется сразу после отправки, поэтому кратковременные пики не теряются
+static void IRAM_ATTR perfQueueSent(QueueHandle_t queue, bool sent, bool isr)
+{
+  uint8_t count = _queuesCount;
+  for (uint8_t i = 0; i < count; i++) {
+    if (_queues[i].queue == queue) {
+      UBaseType_t waiting = isr ? uxQueueMessagesWaitingFromISR(queue) : uxQueueMessagesWaiting(queue);
+      portENTER_CRITICAL_SAFE(&_perfMux);
+      if (waiting > _queues[i].peak) _queues[i].peak = waiting;
+      if (!sent) _queues[i].full++;
+      portEXIT_CRITICAL_SAFE(&_perfMux);
+      break;
+    };
+  };
+}
+
+static bool perfAppendQueues(char** json, uint8_t count)
+{
+  bool ok = true;
+  for (uint8_t i = 0; ok && (i < count); i++) {
+    portENTER_CRITICAL(&_perfMux);
+    _queuesSent[i] = _queues[i];
+    portEXIT_CRITICAL(&_perfMux);
+    ok = scratchAppendf(&_perfScratch, json, i > 0 ? "," : nullptr, "\"%s\":{\"size\":%u,\"peak\":%u,\"full\":%u}", 
+      _queuesSent[i].name, (unsigned)_queuesSent[i].size, (unsigned)_queuesSent[i].peak, (unsigned)_queuesSent[i].full);
+  };
+  return ok;
+}
+
+// Сброс после успешной отправки: отказы, случившиеся во время отправки, переходят в следующий интервал
+static void perfCommitQueues(uint8_t count)
+{
+  portENTER_CRITICAL(&_perfMux);
+  for (uint8_t i = 0; i < count; i++) {
+    _queues[i].full -= _queuesSent[i].full;
+    if (_queues[i].peak <= _queuesSent[i].peak) _queues[i].peak = 0;
+  };
+  portEXIT_CRITICAL(&_perfMux);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Дополнительные разделы ----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  const char* name;
+  perf_section_cb_t callback;
+} perf_section_t;
+
+static perf_section_t _sections[CONFIG_PERFSTAT_SECTIONS];
+static uint8_t _sectionsCount = 0;
+
+bool perfSectionRegister(const char* name, perf_section_cb_t callback)
+{
+  if (callback == nullptr) return false;
+  bool ret = false;
+  portENTER_CRITICAL(&_perfMux);
+  if (_sectionsCount < CONFIG_PERFSTAT_SECTIONS) {
+    _sections[_sectionsCount].name = name;
+    _sections[_sectionsCount].callback = callback;
+    _sectionsCount++;
+    ret = true;
+  };
+  portEXIT_CRITICAL(&_perfMux);
+  if (!ret) {
+    rlog_e(logTAG, "Failed to register section [ %s ]: too many sections", name);
+  };
+  return ret;
+}
+
+static bool perfAppendSections(char** json)
+{
+  bool ok = true;
+  uint8_t count = _sectionsCount;
+  for (uint8_t i = 0; ok && (i < count); i++) {
+    ok = scratchAppendf(&_perfScratch, json, nullptr, ",\"%s\":", _sections[i].name)
+      && _sections[i].callback(&_perfScratch, json);
+  };
+  return ok;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Публикация ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static bool perfAppendMetrics(char** json, uint8_t count)
+{
+  bool ok = true;
+  for (uint8_t i = 0; ok && (i < count); i++) {
+    // Копируем метрику, чтобы не блокировать измерения на время расчетов; сбрасывается она только после отправки
+    perf_data_t* snapshot = &_metricsSent[i];
+    portENTER_CRITICAL(&_perfMux);
+    *snapshot = _metrics[i];
+    portEXIT_CRITICAL(&_perfMux);
+
+    uint32_t total = 0;
+    for (uint8_t j = 0; j < PERFSTAT_BUCKETS; j++) {
+      total += snapshot->buckets[j];
+    };
+    ok = scratchAppendf(&_perfScratch, json, i > 0 ? "," : nullptr, 
+      "\"%s\":{\"n\":%" PRIu32 ",\"avg\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+      snapshot->name, snapshot->count, 
+      snapshot->count > 0 ? (uint32_t)(snapshot->sum / snapshot->count) : 0,
+      perfPercentile(snapshot, total, 50), perfPercentile(snapshot, total, 99), snapshot->max);
+  };
+  return ok;
+}
+
+// Вычитаем отправленное: измерения, добавленные во время формирования сообщения, переходят в следующий интервал
+static void perfCommitMetrics(uint8_t count)
+{
+  for (uint8_t i = 0; i < count; i++) {
+    const perf_data_t* snapshot = &_metricsSent[i];
+    portENTER_CRITICAL(&_perfMux);
+    _metrics[i].count -= snapshot->count;
+    _metrics[i].sum -= snapshot->sum;
+    if (_metrics[i].max <= snapshot->max) _metrics[i].max = 0;
+    for (uint8_t j = 0; j < PERFSTAT_BUCKETS; j++) {
+      _metrics[i].buckets[j] -= snapshot->buckets[j];
+    };
+    portEXIT_CRITICAL(&_perfMux);
+  };
+}
+
+static bool perfAppendTasks(char** json)
+{
+  bool ok = true;
+  UBaseType_t count = uxTaskGetNumberOfTasks();
+  TaskStatus_t* tasks = (TaskStatus_t*)esp_malloc(count * sizeof(TaskStatus_t));
+  if (tasks) {
+    uint32_t runtime = 0;
+    count = uxTaskGetSystemState(tasks, count, &runtime);
+    for (UBaseType_t i = 0; ok && (i < count); i++) {
+      #if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        ok = scratchAppendf(&_perfScratch, json, i > 0 ? "," : nullptr, "\"%s\":{\"stack_min\":%" PRIu32 ",\"cpu\":%.1f}", 
+          tasks[i].pcTaskName, (uint32_t)tasks[i].usStackHighWaterMark, 
+          runtime > 0 ? 100.0 * (double)tasks[i].ulRunTimeCounter / (double)runtime : 0.0);
+      #else
+        ok = scratchAppendf(&_perfScratch, json, i > 0 ? "," : nullptr, "\"%s\":{\"stack_min\":%" PRIu32 "}", 
+          tasks[i].pcTaskName, (uint32_t)tasks[i].usStackHighWaterMark);
+      #endif // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    };
+    free(tasks);
+  };
+  return ok;
+}
+
+// Сообщение собирается целиком в статическом буфере, mqttPublish() копирует его в очередь клиента.
+// Если сообщение не поместилось в буфер или не было отправлено, метрики не сбрасываются и уйдут в следующий раз
+static void perfPublish()
+{
+  char topic[CONFIG_PERFSTAT_TOPIC_SIZE];
+  memset(topic, 0, sizeof(topic));
+  portENTER_CRITICAL(&_perfMux);
+  if (_perfTopic) strncpy(topic, _perfTopic, sizeof(topic) - 1);
+  portEXIT_CRITICAL(&_perfMux);
+
+  if (topic[0] && statesMqttIsConnected()) {
+    uint8_t metrics = _metricsCount;
+    uint8_t queues = _queuesCount;
+    scratchReset(&_perfScratch);
+    char* json = nullptr;
+    bool ok = scratchAppendf(&_perfScratch, &json, nullptr, "{\"latency_us\":{")
+      && perfAppendMetrics(&json, metrics)
+      && scratchAppendf(&_perfScratch, &json, nullptr, "},\"queues\":{")
+      && perfAppendQueues(&json, queues)
+      && scratchAppendf(&_perfScratch, &json, nullptr, "},\"heap\":{\"free\":%u,\"low\":%u},\"tasks\":{",
+          (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT), (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT))
+      && perfAppendTasks(&json)
+      && scratchAppendf(&_perfScratch, &json, nullptr, "}")
+      && perfAppendSections(&json)
+      && scratchAppendf(&_perfScratch, &json, nullptr, "}");
+    if (!ok) {
+      rlog_e(logTAG, "Performance statistics do not fit into %d bytes", CONFIG_PERFSTAT_JSON_SIZE);
+    } else if (mqttPublish(topic, json, CONFIG_PERFSTAT_QOS, CONFIG_PERFSTAT_RETAINED, false, false) == ESP_OK) {
+      perfCommitMetrics(metrics);
+      perfCommitQueues(queues);
+    };
+  };
+}
+
+// Опрос задач, выделение памяти и отправка выполняются в отдельной задаче, а не в общей задаче esp_timer
+static void perfTaskExec(void *pvParameters)
+{
+  TickType_t prevWakeup = xTaskGetTickCount();
+  while (1) {
+    vTaskDelayUntil(&prevWakeup, pdMS_TO_TICKS(CONFIG_PERFSTAT_INTERVAL));
+    perfPublish();
+  };
+  vTaskDelete(nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Event handlers ---------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Замена топика под блокировкой, старая строка освобождается уже вне критической секции
+static void perfTopicSet(char* topic)
+{
+  portENTER_CRITICAL(&_perfMux);
+  char* old = _perfTopic;
+  _perfTopic = topic;
+  portEXIT_CRITICAL(&_perfMux);
+  if (old) free(old);
+}
+
+static void perfMqttEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if (event_id == RE_MQTT_CONNECTED) {
+    re_mqtt_event_data_t* data = (re_mqtt_event_data_t*)event_data;
+    perfTopicSet(mqttGetTopicDevice1(data->primary, CONFIG_PERFSTAT_LOCAL, CONFIG_PERFSTAT_TOPIC));
+  } else if ((event_id == RE_MQTT_CONN_LOST) || (event_id == RE_MQTT_CONN_FAILED)) {
+    perfTopicSet(nullptr);
+  };
+}
+
+bool perfEventHandlerRegister()
+{
+  _perfMqttPublish = perfRegister("mqtt_publish");
+
+  if (_perfTask == nullptr) {
+    _perfTask = xTaskCreateStaticPinnedToCore(perfTaskExec, perfTaskName,
+      CONFIG_PERFSTAT_TASK_STACK_SIZE, NULL, CONFIG_PERFSTAT_TASK_PRIORITY, _perfTaskStack, &_perfTaskBuffer, CONFIG_PERFSTAT_TASK_CORE);
+    if (_perfTask) {
+      rloga_i("Task [ %s ] has been successfully created and started", perfTaskName);
+    } else {
+      rloga_e("Failed to create a task for performance statistics!");
+      return false;
+    };
+  };
+
+  return eventHandlerRegister(RE_MQTT_EVENTS, ESP_EVENT_ANY_ID, &perfMqttEventHandler, nullptr);
+}
+
+#endif // CONFIG_PERFSTAT_ENABLE
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Подмена mqttPublish() -----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Время постановки сообщения в очередь MQTT клиента (подменяется через -Wl,--wrap=mqttPublish)
+extern "C" esp_err_t __wrap_mqttPublish(char *topic, char *payload, int qos, bool retained, bool free_topic, bool free_payload)
+{
+  #if CONFIG_PERFSTAT_ENABLE
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = __real_mqttPublish(topic, payload, qos, retained, free_topic, free_payload);
+    perfRecord(_perfMqttPublish, (uint32_t)(esp_timer_get_time() - start));
+    return ret;
+  #else
+    return __real_mqttPublish(topic, payload, qos, retained, free_topic, free_payload);
+  #endif // CONFIG_PERFSTAT_ENABLE
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------- Подмена xQueueGenericSend() -------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Заполнение очередей у всех отправителей, в том числе внутри библиотек (reAlarm, reRx433), которые нельзя изменить
+// (подменяются через -Wl,--wrap=xQueueGenericSend и -Wl,--wrap=xQueueGenericSendFromISR)
+extern "C" BaseType_t IRAM_ATTR __wrap_xQueueGenericSend(QueueHandle_t xQueue, const void * const pvItemToQueue, 
+  TickType_t xTicksToWait, const BaseType_t xCopyPosition)
+{
+  BaseType_t ret = __real_xQueueGenericSend(xQueue, pvItemToQueue, xTicksToWait, xCopyPosition);
+  #if CONFIG_PERFSTAT_ENABLE
+    perfQueueSent(xQueue, ret == pdPASS, false);
+  #endif // CONFIG_PERFSTAT_ENABLE
+  return ret;
+}
+
+extern "C" BaseType_t IRAM_ATTR __wrap_xQueueGenericSendFromISR(QueueHandle_t xQueue, const void * const pvItemToQueue, 
+  BaseType_t * const pxHigherPriorityTaskWoken, const BaseType_t xCopyPosition)
+{
+  BaseType_t ret = __real_xQueueGenericSendFromISR(xQueue, pvItemToQueue, pxHigherPriorityTaskWoken, xCopyPosition);
+  #if CONFIG_PERFSTAT_ENABLE
+    perfQueueSent(xQueue, ret == pdPASS, true);
+  #endif // CONFIG_PERFSTAT_ENABLE
+  return ret;
+}
@@ -0,0 +1,154 @@
+/*
+   Модуль измерения задержек "горячих" участков кода.
+   Каждая метрика хранит лог-линейную гистограмму (4 интервала на каждую степень двойки, от 1 мкс до ~33 с)
+   в статической памяти. Раз в CONFIG_PERFSTAT_INTERVAL на MQTT публикуются количество, среднее, p50, p99 и максимум
+   для каждой метрики за прошедший интервал, а также минимальный остаток стека (и загрузка CPU, если разрешена 
+   CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS) для каждой задачи; гистограммы сбрасываются только после успешной отправки.
+   Заполнение зарегистрированных очередей фиксируется в момент отправки любым отправителем, включая библиотеки и 
+   прерывания (xQueueGenericSend() и xQueueGenericSendFromISR() подменяются через -Wl,--wrap), что дает максимальное
+   заполнение и количество отклоненных сообщений за интервал публикации; минимум свободной памяти берется у
+   heap_caps_get_minimum_free_size() (с момента запуска). Другие модули могут добавить в сообщение свои разделы 
+   (perfSectionRegister). Сбор и отправка выполняются в отдельной задаче с низким приоритетом.
+   При CONFIG_PERFSTAT_ENABLE = 0 все макросы и функции компилируются в пустые
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __PERFSTAT_H__
+#define __PERFSTAT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "project_config.h"
+#include "scratch.h"
+
+#ifndef CONFIG_PERFSTAT_ENABLE
+#define CONFIG_PERFSTAT_ENABLE 0
+#endif // CONFIG_PERFSTAT_ENABLE
+
+// Максимальное количество метрик
+#ifndef CONFIG_PERFSTAT_METRICS
+#define CONFIG_PERFSTAT_METRICS 12
+#endif // CONFIG_PERFSTAT_METRICS
+
+// Интервал публикации, мс
+#ifndef CONFIG_PERFSTAT_INTERVAL
+#define CONFIG_PERFSTAT_INTERVAL 1000*60*15
+#endif // CONFIG_PERFSTAT_INTERVAL
+
+// Максимальное количество отслеживаемых очередей
+#ifndef CONFIG_PERFSTAT_QUEUES
+#define CONFIG_PERFSTAT_QUEUES 4
+#endif // CONFIG_PERFSTAT_QUEUES
+
+// Максимальное количество дополнительных разделов
+#ifndef CONFIG_PERFSTAT_SECTIONS
+#define CONFIG_PERFSTAT_SECTIONS 4
+#endif // CONFIG_PERFSTAT_SECTIONS
+
+// Параметры задачи публикации
+#ifndef CONFIG_PERFSTAT_TASK_STACK_SIZE
+#define CONFIG_PERFSTAT_TASK_STACK_SIZE 3072
+#endif // CONFIG_PERFSTAT_TASK_STACK_SIZE
+
+#ifndef CONFIG_PERFSTAT_TASK_PRIORITY
+#define CONFIG_PERFSTAT_TASK_PRIORITY 2
+#endif // CONFIG_PERFSTAT_TASK_PRIORITY
+
+#ifndef CONFIG_PERFSTAT_TASK_CORE
+#define CONFIG_PERFSTAT_TASK_CORE 1
+#endif // CONFIG_PERFSTAT_TASK_CORE
+
+// Размер буфера для формирования сообщения
+#ifndef CONFIG_PERFSTAT_JSON_SIZE
+#define CONFIG_PERFSTAT_JSON_SIZE 4096
+#endif // CONFIG_PERFSTAT_JSON_SIZE
+
+#ifndef CONFIG_PERFSTAT_TOPIC
+#define CONFIG_PERFSTAT_TOPIC "perf"
+#endif // CONFIG_PERFSTAT_TOPIC
+
+// Максимальная длина полного топика
+#ifndef CONFIG_PERFSTAT_TOPIC_SIZE
+#define CONFIG_PERFSTAT_TOPIC_SIZE 128
+#endif // CONFIG_PERFSTAT_TOPIC_SIZE
+
+#ifndef CONFIG_PERFSTAT_LOCAL
+#define CONFIG_PERFSTAT_LOCAL 0
+#endif // CONFIG_PERFSTAT_LOCAL
+
+#ifndef CONFIG_PERFSTAT_QOS
+#define CONFIG_PERFSTAT_QOS 0
+#endif // CONFIG_PERFSTAT_QOS
+
+#ifndef CONFIG_PERFSTAT_RETAINED
+#define CONFIG_PERFSTAT_RETAINED 0
+#endif // CONFIG_PERFSTAT_RETAINED
+
+typedef int8_t perf_metric_t;
+#define PERF_METRIC_NONE -1
+
+// Дописывает значение раздела (объект JSON) в строку json арены arena, false - если не хватило места
+typedef bool (*perf_section_cb_t)(scratch_arena_t* arena, char** json);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_PERFSTAT_ENABLE
+
+/**
+ * Регистрация метрики (name должна быть статической строкой). 
+ * Повторная регистрация с тем же именем возвращает ту же метрику
+ * */
+perf_metric_t perfRegister(const char* name);
+
+/**
+ * Добавить измерение длительностью duration_us
+ * */
+void perfRecord(perf_metric_t metric, uint32_t duration_us);
+
+/**
+ * Отметка начала длительного процесса, который завершается в другой задаче (например, от срабатывания зоны до сирены).
+ * perfMarkRecord() учитывает время от отметки, если она не старше max_age_us, и сбрасывает отметку
+ * */
+void perfMarkSet(perf_metric_t metric);
+void perfMarkRecord(perf_metric_t metric, uint32_t max_age_us);
+
+/**
+ * Отслеживание максимального заполнения очереди за интервал публикации (name должна быть статической строкой)
+ * */
+bool perfQueueRegister(const char* name, QueueHandle_t queue);
+
+/**
+ * Дополнительный раздел сообщения "name":{...} (name должна быть статической строкой). 
+ * callback вызывается из задачи публикации
+ * */
+bool perfSectionRegister(const char* name, perf_section_cb_t callback);
+
+/**
+ * Регистрация обработчиков событий MQTT и запуск задачи публикации
+ * */
+bool perfEventHandlerRegister();
+
+#else
+
+static inline perf_metric_t perfRegister(const char* name) { return PERF_METRIC_NONE; }
+static inline void perfRecord(perf_metric_t metric, uint32_t duration_us) {}
+static inline void perfMarkSet(perf_metric_t metric) {}
+static inline void perfMarkRecord(perf_metric_t metric, uint32_t max_age_us) {}
+static inline bool perfQueueRegister(const char* name, QueueHandle_t queue) { return true; }
+static inline bool perfSectionRegister(const char* name, perf_section_cb_t callback) { return true; }
+static inline bool perfEventHandlerRegister() { return true; }
+
+#endif // CONFIG_PERFSTAT_ENABLE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PERFSTAT_H__
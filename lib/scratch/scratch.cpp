@@ -0,0 +1,83 @@
+#include "scratch.h"
+#include <stdio.h>
+#include <string.h>
+#include "rLog.h"
+
+static const char* logTAG = "SCRT";
+
+void scratchInit(scratch_arena_t* arena, char* buf, size_t size)
+{
+  arena->base = buf;
+  arena->size = size;
+  arena->used = 0;
+  arena->peak = 0;
+  arena->overflows = 0;
+  arena->last = nullptr;
+}
+
+void scratchReset(scratch_arena_t* arena)
+{
+  arena->used = 0;
+  arena->last = nullptr;
+}
+
+static char* scratchVPrintf(scratch_arena_t* arena, const char* format, va_list args)
+{
+  size_t avail = arena->size - arena->used;
+  char* str = arena->base + arena->used;
+  int len = vsnprintf(str, avail, format, args);
+  if ((len < 0) || ((size_t)len >= avail)) {
+    arena->overflows++;
+    rlog_w(logTAG, "Scratch buffer overflow: %d of %d bytes used, %d required", arena->used, arena->size, len + 1);
+    if (avail > 0) *str = 0;
+    return nullptr;
+  };
+  arena->used += len + 1;
+  if (arena->used > arena->peak) arena->peak = arena->used;
+  arena->last = str;
+  return str;
+}
+
+char* scratchPrintf(scratch_arena_t* arena, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  char* ret = scratchVPrintf(arena, format, args);
+  va_end(args);
+  return ret;
+}
+
+bool scratchAppendf(scratch_arena_t* arena, char** str, const char* div, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  bool ret = false;
+  if (*str == nullptr) {
+    *str = scratchVPrintf(arena, format, args);
+    ret = *str != nullptr;
+  } else if (*str == arena->last) {
+    // Последняя строка: терминирующий ноль перезаписывается продолжением
+    size_t len = strlen(*str);
+    size_t divlen = ((len > 0) && div) ? strlen(div) : 0;
+    size_t end = (*str - arena->base) + len;
+    size_t avail = arena->size - end;
+    int add = -1;
+    if (divlen < avail) {
+      if (divlen > 0) memcpy(arena->base + end, div, divlen);
+      add = vsnprintf(arena->base + end + divlen, avail - divlen, format, args);
+    };
+    if ((add < 0) || (divlen + (size_t)add >= avail)) {
+      arena->overflows++;
+      rlog_w(logTAG, "Scratch buffer overflow: %d of %d bytes used", arena->used, arena->size);
+      (*str)[len] = 0;
+    } else {
+      arena->used = end + divlen + add + 1;
+      if (arena->used > arena->peak) arena->peak = arena->used;
+      ret = true;
+    };
+  } else {
+    rlog_e(logTAG, "Only the last scratch string can be appended");
+  };
+  va_end(args);
+  return ret;
+}
@@ -0,0 +1,59 @@
+/*
+   Модуль временного буфера (арены) для формирования строк без обращения к куче.
+   Строки размещаются последовательно в статическом буфере владельца и освобождаются все разом вызовом scratchReset()
+   в начале очередного цикла публикации. Замена связки malloc_stringf() + concat_strings_div() там, где строка 
+   нужна только до конца цикла (например, данные для dsSend(), который копирует их в свою очередь).
+   Арена не потокобезопасна: каждая задача использует свою
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __SCRATCH_H__
+#define __SCRATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+typedef struct {
+  char* base;
+  size_t size;
+  size_t used;
+  size_t peak;          // Максимальное заполнение с момента инициализации
+  uint32_t overflows;   // Количество строк, не поместившихся в буфер
+  char* last;           // Последняя размещенная строка (только ее можно дополнять)
+} scratch_arena_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Инициализация арены на буфере buf размером size
+ * */
+void scratchInit(scratch_arena_t* arena, char* buf, size_t size);
+
+/**
+ * Освобождение всех строк арены
+ * */
+void scratchReset(scratch_arena_t* arena);
+
+/**
+ * Форматирование новой строки в арене. Возвращает nullptr, если строка не помещается
+ * */
+char* scratchPrintf(scratch_arena_t* arena, const char* format, ...);
+
+/**
+ * Дополнение строки str (через разделитель div, если строка не пустая) без копирования. 
+ * Если str == nullptr, создается новая строка. Дополнять можно только последнюю размещенную строку.
+ * При нехватке места строка остается прежней, а функция возвращает false
+ * */
+bool scratchAppendf(scratch_arena_t* arena, char** str, const char* div, const char* format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCRATCH_H__
@@ -5,24 +5,17 @@
 #include "def_consts.h"
 #include "rTypes.h"
 #include "reGpio.h"
+#include "zonescan.h"
+#include "zoneexp.h"
 #include "reLed.h"
+#include "annunciator.h"
+#include "perfstat.h"
 #include "reEvents.h"
 #include "reParams.h"
 #include "rLog.h"
 
 static const char* logTAG = "ALARM";
 
-// -----------------------------------------------------------------------------------------------------------------------
-// --------------------------------------------------- Проводные входы ---------------------------------------------------
-// -----------------------------------------------------------------------------------------------------------------------
-
-// Объекты reGPIO для обработки прерываний по проводным входым ОПС
-static reGPIO gpioAlarm1(CONFIG_GPIO_ALARM_ZONE_1, CONFIG_GPIO_ALARM_LEVEL, false, true, CONFIG_BUTTON_DEBOUNCE_TIME_US, nullptr);
-static reGPIO gpioAlarm2(CONFIG_GPIO_ALARM_ZONE_2, CONFIG_GPIO_ALARM_LEVEL, false, true, CONFIG_BUTTON_DEBOUNCE_TIME_US, nullptr);
-static reGPIO gpioAlarm3(CONFIG_GPIO_ALARM_ZONE_3, CONFIG_GPIO_ALARM_LEVEL, false, true, CONFIG_BUTTON_DEBOUNCE_TIME_US, nullptr);
-static reGPIO gpioAlarm4(CONFIG_GPIO_ALARM_ZONE_4, CONFIG_GPIO_ALARM_LEVEL, false, true, CONFIG_BUTTON_DEBOUNCE_TIME_US, nullptr);
-static reGPIO gpioAlarm5(CONFIG_GPIO_ALARM_ZONE_5, CONFIG_GPIO_ALARM_LEVEL, false, true, CONFIG_BUTTON_DEBOUNCE_TIME_US, nullptr);
-
 // -----------------------------------------------------------------------------------------------------------------------
 // ----------------------------------------------------- Инициализация ---------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -31,32 +24,34 @@ void alarmInitDevices()
 {
   rlog_i(logTAG, "Initialization of AFS devices");
 
-  // Создаем светодиоды, сирену и флешер
+  // Создаем светодиоды, сирену и флешер (все выходы обслуживаются одной задачей)
   ledQueue_t ledAlarm = nullptr;
   #if defined(CONFIG_GPIO_ALARM_LED) && (CONFIG_GPIO_ALARM_LED > -1)
-    ledAlarm = ledTaskCreate(CONFIG_GPIO_ALARM_LED, true, true, "led_alarm", CONFIG_LED_TASK_STACK_SIZE, nullptr);
+    ledAlarm = annunciatorAdd(CONFIG_GPIO_ALARM_LED, true, true, "led_alarm", nullptr);
     ledTaskSend(ledAlarm, lmOff, 0, 0, 0);
   #endif // CONFIG_GPIO_ALARM_LED
   ledQueue_t siren = nullptr;
   #if defined(CONFIG_GPIO_ALARM_SIREN) && (CONFIG_GPIO_ALARM_SIREN > -1)
-    siren = ledTaskCreate(CONFIG_GPIO_ALARM_SIREN, true, false, "siren", CONFIG_LED_TASK_STACK_SIZE, nullptr);
+    siren = annunciatorAdd(CONFIG_GPIO_ALARM_SIREN, true, false, "siren", nullptr);
+    annunciatorSetAlarmOutput(siren);
     ledTaskSend(siren, lmOff, 0, 0, 0);
   #endif // CONFIG_GPIO_ALARM_SIREN
   ledQueue_t flasher = nullptr;
   #if defined(CONFIG_GPIO_ALARM_FLASH) && (CONFIG_GPIO_ALARM_FLASH > -1)
-    flasher = ledTaskCreate(CONFIG_GPIO_ALARM_FLASH, true, true, "flasher", CONFIG_LED_TASK_STACK_SIZE, nullptr);
+    flasher = annunciatorAdd(CONFIG_GPIO_ALARM_FLASH, true, true, "flasher", nullptr);
     ledTaskSend(flasher, lmBlinkOn, 1, 100, 5000);
   #endif // CONFIG_GPIO_ALARM_FLASH
   
   // Замена пассивной пищалки на активную
   ledQueue_t buzzer = nullptr;
   #if defined(CONFIG_GPIO_BUZZER_ACTIVE) && (CONFIG_GPIO_BUZZER_ACTIVE > -1)
-    buzzer = ledTaskCreate(CONFIG_GPIO_BUZZER_ACTIVE, true, false, "buzzer", CONFIG_LED_TASK_STACK_SIZE, nullptr);
+    buzzer = annunciatorAdd(CONFIG_GPIO_BUZZER_ACTIVE, true, false, "buzzer", nullptr);
     ledTaskSend(buzzer, lmOff, 0, 0, 0);
   #endif // CONFIG_GPIO_ALARM_FLASH
   
   // Запускаем задачу
   alarmTaskCreate(siren, flasher, buzzer, ledAlarm, ledAlarm, nullptr);
+  perfQueueRegister("alarm", alarmTaskQueue());
 
   // Запускаем приемник RX 433 MHz
   #ifdef CONFIG_GPIO_RX433
@@ -175,7 +170,7 @@ void alarmInitSensors()
   // -----------------------------------------------------------------------------------
 
   // Проводная зона 1: входная дверь
-  gpioAlarm1.initGPIO();
+  zoneScanAdd(CONFIG_GPIO_ALARM_ZONE_1, CONFIG_GPIO_ALARM_LEVEL, false, CONFIG_BUTTON_DEBOUNCE_TIME_US);
   alarmSensorHandle_t asWired1 = alarmSensorAdd(
     AST_WIRED,                                      // Тип датчика: проводные датчики
     "Входная дверь",                                // Понятное имя датчика
@@ -194,7 +189,7 @@ void alarmInitSensors()
   };
  
   // Проводная зона 2: PIR сенсор в прихожей
-  gpioAlarm2.initGPIO();
+  zoneScanAdd(CONFIG_GPIO_ALARM_ZONE_2, CONFIG_GPIO_ALARM_LEVEL, false, CONFIG_BUTTON_DEBOUNCE_TIME_US);
   alarmSensorHandle_t asWired2 = alarmSensorAdd(AST_WIRED, "Прихожая", "hallway", CONFIG_ALARM_LOCAL_PUBLISH, CONFIG_GPIO_ALARM_ZONE_2);
   if (asWired2) {
     alarmEventSet(asWired2, azIndoor, 0, ASE_ALARM, 
@@ -207,7 +202,7 @@ void alarmInitSensors()
   };
 
   // Проводная зона 3: 
-  gpioAlarm3.initGPIO();
+  zoneScanAdd(CONFIG_GPIO_ALARM_ZONE_3, CONFIG_GPIO_ALARM_LEVEL, false, CONFIG_BUTTON_DEBOUNCE_TIME_US);
   alarmSensorHandle_t asGasLeak = alarmSensorAdd(AST_WIRED, "Газ", "gas", CONFIG_ALARM_LOCAL_PUBLISH, CONFIG_GPIO_ALARM_ZONE_3);
   if (asGasLeak) {
     alarmEventSet(asGasLeak, azTech, 0, ASE_ALARM, 
@@ -220,7 +215,7 @@ void alarmInitSensors()
   };
 
   // Проводная зона 4: контроль питания 220В
-  gpioAlarm4.initGPIO();
+  zoneScanAdd(CONFIG_GPIO_ALARM_ZONE_4, CONFIG_GPIO_ALARM_LEVEL, false, CONFIG_BUTTON_DEBOUNCE_TIME_US);
   alarmSensorHandle_t asPowerMain = alarmSensorAdd(AST_WIRED, "Питание 220В", "main_power", CONFIG_ALARM_LOCAL_PUBLISH, CONFIG_GPIO_ALARM_ZONE_4);
   if (asPowerMain) {
     alarmEventSet(asPowerMain, azPower, 0, ASE_POWER, 
@@ -233,7 +228,7 @@ void alarmInitSensors()
   };
 
   // Проводная зона 5: контроль заряда аккумулятора
-  gpioAlarm5.initGPIO();
+  zoneScanAdd(CONFIG_GPIO_ALARM_ZONE_5, CONFIG_GPIO_ALARM_LEVEL, false, CONFIG_BUTTON_DEBOUNCE_TIME_US);
   alarmSensorHandle_t asBattery = alarmSensorAdd(AST_WIRED, "Аккумулятор", "battery", false, CONFIG_GPIO_ALARM_ZONE_5);
   if (asBattery) {
     alarmEventSet(asBattery, azPower, 0, ASE_POWER, 
@@ -245,6 +240,24 @@ void alarmInitSensors()
       false);                                       // Тревога без подтверждения с других датчиков
   };
 
+  // Запускаем опрос проводных зон: начальные состояния и все последующие изменения передаются в очередь задачи ОПС
+  zoneScanStart(alarmTaskQueue());
+  perfSectionRegister("zonescan", zoneScanStatsAppend);
+
+  // -----------------------------------------------------------------------------------
+  // Проводные входы на расширителе MCP23017
+  // -----------------------------------------------------------------------------------
+
+  #if defined(CONFIG_GPIO_ZONEEXP_INT)
+    // Все 16 выводов - входы с внутренней подтяжкой; изменения передаются в очередь задачи ОПС по прерыванию, без опроса шины.
+    // Датчики привязываются по адресу вывода, например:
+    // alarmSensorAdd(AST_WIRED, "Окно", "window", false, ZONEEXP_SENSOR_ADDRESS(CONFIG_ZONEEXP_I2C_PORT, CONFIG_ZONEEXP_ADDRESS, 0));
+    if (zoneExpAdd(CONFIG_ZONEEXP_I2C_PORT, CONFIG_ZONEEXP_ADDRESS, CONFIG_GPIO_ZONEEXP_INT, 
+        CONFIG_ZONEEXP_ACTIVE_LOW, 0xFFFF, CONFIG_ZONEEXP_DEBOUNCE_MS) >= 0) {
+      zoneExpStart(alarmTaskQueue());
+    };
+  #endif // CONFIG_GPIO_ZONEEXP_INT
+
   // -----------------------------------------------------------------------------------
   // Беспроводные датчики 433 МГц
   // -----------------------------------------------------------------------------------
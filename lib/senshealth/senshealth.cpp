@@ -0,0 +1,107 @@
+#include "senshealth.h"
+#include <string.h>
+#include <math.h>
+#include "rLog.h"
+
+static const char* logTAG = "HLTH";
+
+void sensHealthInit(sens_health_t* item, const char* name, float min, float max, float max_rate,
+  float stuck_delta, uint32_t stuck_s, uint32_t stale_s, sens_health_cb_t cb)
+{
+  memset(item, 0, sizeof(sens_health_t));
+  item->name = name;
+  item->min = min;
+  item->max = max;
+  item->max_rate = max_rate;
+  item->stuck_delta = stuck_delta;
+  item->stuck_s = stuck_s;
+  item->stale_s = stale_s;
+  item->cb = cb;
+  item->last = NAN;
+  item->stuck_ref = NAN;
+  // До истечения stale_s с момента запуска источник считается исправным, чтобы не поднимать тревогу при старте
+  item->score = 100;
+  item->healthy = true;
+}
+
+float sensHealthCheck(sens_health_t* item, float value, int64_t now)
+{
+  uint8_t faults = 0;
+
+  if (isnan(value)) {
+    // Сенсор не ответил: ошибка только по истечении stale_s, отдельные пропуски не снижают оценку
+    if ((now - item->last_time) >= (int64_t)item->stale_s * 1000000) {
+      faults |= SENSHEALTH_STALE;
+    };
+  } else if ((value < item->min) || (value > item->max)) {
+    faults |= SENSHEALTH_RANGE;
+    if ((now - item->last_time) >= (int64_t)item->stale_s * 1000000) {
+      faults |= SENSHEALTH_STALE;
+    };
+  } else {
+    // Скорость изменения относительно предыдущего показания. Новое значение все равно запоминается:
+    // одиночный выброс даст две ошибки подряд, а реальный скачок - только одну
+    if ((item->max_rate > 0.0) && !isnan(item->last) && (now > item->last_time)) {
+      float rate = fabsf(value - item->last) * 60000000.0 / (float)(now - item->last_time);
+      if (rate > item->max_rate) {
+        faults |= SENSHEALTH_RATE;
+      };
+    };
+    // Залипание: отсчет сбрасывается, как только значение изменилось больше чем на stuck_delta
+    if (isnan(item->stuck_ref) || (fabsf(value - item->stuck_ref) >= item->stuck_delta)) {
+      item->stuck_ref = value;
+      item->stuck_time = now;
+    } else if ((item->stuck_s > 0) && ((now - item->stuck_time) >= (int64_t)item->stuck_s * 1000000)) {
+      faults |= SENSHEALTH_STUCK;
+    };
+    item->last = value;
+    item->last_time = now;
+  };
+
+  // Пропуск без признаков устаревания не влияет на оценку
+  if (!isnan(value) || faults) {
+    if (faults) {
+      item->score -= item->score >> CONFIG_SENSHEALTH_SMOOTH_SHIFT;
+      item->fault_counts++;
+    } else {
+      item->score += (100 - item->score + (1 << CONFIG_SENSHEALTH_SMOOTH_SHIFT) - 1) >> CONFIG_SENSHEALTH_SMOOTH_SHIFT;
+    };
+  };
+  item->faults = faults;
+
+  // Устаревание и залипание выводят источник из работы сразу, выбросы - через снижение оценки
+  // (сами ошибочные показания не используются в любом случае)
+  bool healthy = item->healthy;
+  if (faults & (SENSHEALTH_STALE | SENSHEALTH_STUCK)) {
+    healthy = false;
+  } else if (item->score < CONFIG_SENSHEALTH_FAIL_SCORE) {
+    healthy = false;
+  } else if ((item->score >= CONFIG_SENSHEALTH_OK_SCORE) && (faults == 0)) {
+    healthy = true;
+  };
+  if (healthy != item->healthy) {
+    item->healthy = healthy;
+    if (healthy) {
+      rlog_i(logTAG, "Source [%s] is healthy again, score %d%%", item->name, item->score);
+    } else {
+      rlog_w(logTAG, "Source [%s] is degraded, score %d%%, faults 0x%02X", item->name, item->score, faults);
+    };
+    if (item->cb) item->cb(item, healthy, faults);
+  };
+
+  return (healthy && !isnan(value) && !(faults & (SENSHEALTH_RANGE | SENSHEALTH_RATE))) ? value : NAN;
+}
+
+const char* sensHealthFaultsStr(uint8_t faults, char* buf, uint8_t size)
+{
+  static const char* names[] = { "stale", "range", "rate", "stuck" };
+  buf[0] = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    if (faults & (1U << i)) {
+      if (buf[0]) strncat(buf, ",", size - strlen(buf) - 1);
+      strncat(buf, names[i], size - strlen(buf) - 1);
+    };
+  };
+  if (!buf[0]) strncpy(buf, "none", size);
+  return buf;
+}
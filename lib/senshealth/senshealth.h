@@ -0,0 +1,98 @@
+/*
+   Модуль оценки исправности источников температуры.
+   Каждое новое показание проверяется инкрементально, за O(1), без хранения истории:
+   - устаревание: исправных показаний нет дольше stale_s секунд;
+   - выход за физически возможный диапазон min..max;
+   - недопустимая скорость изменения (скачки), max_rate единиц в минуту;
+   - "залипание": значение не меняется больше чем на stuck_delta дольше stuck_s секунд.
+   По результатам проверок ведется оценка 0..100% (экспоненциальное сглаживание), источник считается неисправным,
+   когда оценка опускается ниже CONFIG_SENSHEALTH_FAIL_SCORE, и снова исправным - когда она превышает
+   CONFIG_SENSHEALTH_OK_SCORE и текущее показание не содержит ошибок (гистерезис исключает "дребезг" состояния).
+   При изменении состояния вызывается callback
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __SENSHEALTH_H__
+#define __SENSHEALTH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "project_config.h"
+
+// Оценка, ниже которой источник считается неисправным, %
+#ifndef CONFIG_SENSHEALTH_FAIL_SCORE
+#define CONFIG_SENSHEALTH_FAIL_SCORE 50
+#endif // CONFIG_SENSHEALTH_FAIL_SCORE
+
+// Оценка, выше которой источник снова считается исправным, %
+#ifndef CONFIG_SENSHEALTH_OK_SCORE
+#define CONFIG_SENSHEALTH_OK_SCORE 80
+#endif // CONFIG_SENSHEALTH_OK_SCORE
+
+// Коэффициент сглаживания оценки: 1/2^N от разницы за одно показание
+#ifndef CONFIG_SENSHEALTH_SMOOTH_SHIFT
+#define CONFIG_SENSHEALTH_SMOOTH_SHIFT 2
+#endif // CONFIG_SENSHEALTH_SMOOTH_SHIFT
+
+// Ошибки показания (битовая маска)
+#define SENSHEALTH_STALE      0x01
+#define SENSHEALTH_RANGE      0x02
+#define SENSHEALTH_RATE       0x04
+#define SENSHEALTH_STUCK      0x08
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sens_health_t sens_health_t;
+
+/**
+ * Callback изменения состояния источника, faults - ошибки последнего показания
+ * */
+typedef void (*sens_health_cb_t)(sens_health_t* item, bool healthy, uint8_t faults);
+
+struct sens_health_t {
+  // Настройки
+  const char* name;
+  float min;
+  float max;
+  float max_rate;           // Единиц в минуту, 0 - не проверяется
+  float stuck_delta;
+  uint32_t stuck_s;         // 0 - не проверяется
+  uint32_t stale_s;
+  sens_health_cb_t cb;
+  // Состояние
+  float last;               // Последнее показание без ошибок диапазона
+  int64_t last_time;        // мкс
+  float stuck_ref;          // Значение, от которого отсчитывается "залипание"
+  int64_t stuck_time;       // мкс
+  uint8_t faults;           // Ошибки последнего показания
+  uint8_t score;            // 0..100 %
+  bool healthy;
+  uint32_t fault_counts;    // Количество показаний с ошибками с момента запуска
+};
+
+/**
+ * Инициализация источника
+ * */
+void sensHealthInit(sens_health_t* item, const char* name, float min, float max, float max_rate,
+  float stuck_delta, uint32_t stuck_s, uint32_t stale_s, sens_health_cb_t cb);
+
+/**
+ * Проверка очередного показания (value может быть NAN, если сенсор не ответил), now - время esp_timer_get_time().
+ * Возвращает value, если источник исправен, иначе NAN
+ * */
+float sensHealthCheck(sens_health_t* item, float value, int64_t now);
+
+/**
+ * Ошибки в виде строки для сообщений, например "stale,rate" (buf не короче 32 символов)
+ * */
+const char* sensHealthFaultsStr(uint8_t faults, char* buf, uint8_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SENSHEALTH_H__
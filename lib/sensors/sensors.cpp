@@ -1,5 +1,6 @@
 #include "sensors.h"
 #include "strings.h"
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <driver/gpio.h>
@@ -17,6 +18,11 @@
 #include "reWiFi.h"
 #include "reRangeMonitor.h"
 #include "reLoadCtrl.h"
+#include "perfstat.h"
+#include "scratch.h"
+#include "timesched.h"
+#include "heatplan.h"
+#include "heatstat.h"
 #if CONFIG_TELEGRAM_ENABLE
 #include "reTgSend.h"
 #endif // CONFIG_TELEGRAM_ENABLE
@@ -31,6 +37,222 @@ static const char* logTAG = "SENS";
 static const char* sensorsTaskName = "sensors";
 static TaskHandle_t _sensorsTask;
 static bool _sensorsNeedStore = false;
+static volatile bool _sensorsOtaActive = false;
+static timesched_t _thermostatSchedule = TIMESCHED_NONE;
+static int8_t _thermostatPeriod = HEATPLAN_NONE;
+
+// Буфер для формирования данных облачных сервисов и сводок MQTT: освобождается целиком один раз за цикл задачи
+// сенсоров, перед блоком публикации. Размер рассчитан на все сводки и строки облачных сервисов одного цикла
+// (около 1 КБ в худшем случае); если места все же не хватит, строка не формируется и отправка пропускается
+#define SENSORS_SCRATCH_SIZE 1536
+static char _sensorsScratchBuf[SENSORS_SCRATCH_SIZE];
+static scratch_arena_t _sensorsScratch;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Последние показания ------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Двойной буфер: писатель один (задача сенсоров) и заполняет слот, который сейчас не опубликован, после чего
+// атомарно публикует номер цикла (младший бит - индекс слота). Опубликованный слот не изменяется, пока не будет
+// опубликован следующий, поэтому вытеснение писателя не задерживает читателей
+static sensors_snapshot_t _sensorsSnapshot[2] = {
+  { 0, 0, NAN, NAN, NAN, NAN, NAN, false, NAN, SENSORS_SOURCE_INDOOR },
+  { 0, 0, NAN, NAN, NAN, NAN, NAN, false, NAN, SENSORS_SOURCE_INDOOR }
+};
+static uint32_t _sensorsSnapshotVer = 0;
+static uint32_t _sensorsCycle = 0;
+
+// Исправность источников температуры и резервная оценка температуры в доме (только задача сенсоров)
+static sens_health_t _healthOutdoor;
+static sens_health_t _healthIndoor;
+static sens_health_t _healthBoiler;
+static uint8_t _controlSource = SENSORS_SOURCE_INDOOR;
+static float _fallbackTemp = NAN;               // Последняя температура в доме: с датчика или оценка модели, °С
+static int64_t _fallbackTime = 0;               // Время последнего обновления _fallbackTemp, мкс
+static int64_t _fallbackStart = 0;              // Начало работы по оценке модели, мкс (0 - датчик исправен)
+static bool _healthChanged = false;
+
+static const char* sensorsSourceName(uint8_t source)
+{
+  switch (source) {
+    case SENSORS_SOURCE_INDOOR: return "датчик в доме";
+    case SENSORS_SOURCE_MODEL:  return "оценка тепловой модели";
+    default:                    return "защита от замерзания";
+  };
+}
+
+static void sensorsHealthChange(sens_health_t* item, bool healthy, uint8_t faults)
+{
+  if (healthy) {
+    tgSend(CONTROL_THERMOSTAT_NOTIFY_KIND, CONTROL_THERMOSTAT_HEALTH_NOTIFY_PRIORITY, CONTROL_THERMOSTAT_NOTIFY_ALARM, CONFIG_TELEGRAM_DEVICE, 
+      CONTROL_THERMOSTAT_NOTIFY_SENSOR_OK, item->name);
+  } else {
+    char buf[32];
+    tgSend(CONTROL_THERMOSTAT_NOTIFY_KIND, CONTROL_THERMOSTAT_HEALTH_NOTIFY_PRIORITY, CONTROL_THERMOSTAT_NOTIFY_ALARM, CONFIG_TELEGRAM_DEVICE, 
+      CONTROL_THERMOSTAT_NOTIFY_SENSOR_FAIL, item->name, sensHealthFaultsStr(faults, buf, sizeof(buf)));
+  };
+  _healthChanged = true;
+}
+
+static void sensorsHealthInit()
+{
+  sensHealthInit(&_healthOutdoor, SENSOR_OUTDOOR_NAME, SENSORS_HEALTH_OUTDOOR_MIN, SENSORS_HEALTH_OUTDOOR_MAX, 
+    SENSORS_HEALTH_OUTDOOR_RATE, SENSORS_HEALTH_OUTDOOR_STUCK_DELTA, SENSORS_HEALTH_OUTDOOR_STUCK_TIME,
+    SENSORS_HEALTH_STALE_TIME, sensorsHealthChange);
+  sensHealthInit(&_healthIndoor, SENSOR_INDOOR_NAME, SENSORS_HEALTH_INDOOR_MIN, SENSORS_HEALTH_INDOOR_MAX, 
+    SENSORS_HEALTH_INDOOR_RATE, SENSORS_HEALTH_INDOOR_STUCK_DELTA, SENSORS_HEALTH_INDOOR_STUCK_TIME,
+    SENSORS_HEALTH_STALE_TIME, sensorsHealthChange);
+  sensHealthInit(&_healthBoiler, SENSOR_BOILER_NAME, SENSORS_HEALTH_BOILER_MIN, SENSORS_HEALTH_BOILER_MAX, 
+    SENSORS_HEALTH_BOILER_RATE, 0.0, 0,
+    SENSORS_HEALTH_STALE_TIME, sensorsHealthChange);
+}
+
+// Температура для управления котлом: пока датчик в доме исправен - его показания (отдельное отбракованное 
+// показание заменяется предыдущим), иначе - оценка, которую тепловая модель ведет от последнего исправного 
+// показания по температурам на улице и теплоносителя, но не дольше CONTROL_THERMOSTAT_FALLBACK_MAX
+static void sensorsControlTemp(sensors_snapshot_t* data, int64_t now)
+{
+  uint8_t source = SENSORS_SOURCE_NONE;
+  if (_healthIndoor.healthy) {
+    source = SENSORS_SOURCE_INDOOR;
+    _fallbackStart = 0;
+    if (!isnan(data->indoor_temp)) {
+      _fallbackTemp = data->indoor_temp;
+      _fallbackTime = now;
+    };
+  } else if (thermostatFallback && thermoModelReady() && !isnan(_fallbackTemp) && !isnan(data->outdoor_temp)) {
+    if (_fallbackStart == 0) {
+      _fallbackStart = now;
+    };
+    if ((now - _fallbackStart) < (int64_t)CONTROL_THERMOSTAT_FALLBACK_MAX * 1000000) {
+      source = SENSORS_SOURCE_MODEL;
+      _fallbackTemp += thermoModelRate(data->boiler_on, _fallbackTemp, data->outdoor_temp, data->boiler_temp) 
+        * (float)(now - _fallbackTime) / 3600000000.0;
+      _fallbackTime = now;
+    };
+  };
+  data->control_temp = (source == SENSORS_SOURCE_NONE) ? NAN : _fallbackTemp;
+  data->control_source = source;
+
+  if (source != _controlSource) {
+    _controlSource = source;
+    _healthChanged = true;
+    rlog_w(logTAG, "Control temperature source changed to %d (0 - indoor sensor, 1 - model estimate, 2 - frost protection)", source);
+    tgSend(CONTROL_THERMOSTAT_NOTIFY_KIND, CONTROL_THERMOSTAT_HEALTH_NOTIFY_PRIORITY, CONTROL_THERMOSTAT_NOTIFY_ALARM, CONFIG_TELEGRAM_DEVICE, 
+      CONTROL_THERMOSTAT_NOTIFY_SOURCE, sensorsSourceName(source));
+  };
+}
+
+static void sensorsSnapshotPublish(bool boiler_on)
+{
+  sensors_snapshot_t data;
+  data.cycle = ++_sensorsCycle;
+  data.time = time(nullptr);
+  bool outdoor_ok = sensorOutdoor.getStatus() == SENSOR_STATUS_OK;
+  int64_t now = esp_timer_get_time();
+  data.outdoor_temp = sensHealthCheck(&_healthOutdoor, outdoor_ok ? sensorOutdoor.getValue2(false).filteredValue : NAN, now);
+  data.outdoor_hum = outdoor_ok ? sensorOutdoor.getValue1(false).filteredValue : NAN;
+  bool indoor_ok = sensorIndoor.getStatus() == SENSOR_STATUS_OK;
+  data.indoor_temp = sensHealthCheck(&_healthIndoor, indoor_ok ? sensorIndoor.getValue2(false).filteredValue : NAN, now);
+  data.indoor_press = indoor_ok ? sensorIndoor.getValue1(false).filteredValue : NAN;
+  data.boiler_temp = sensHealthCheck(&_healthBoiler, 
+    sensorBoiler.getStatus() == SENSOR_STATUS_OK ? sensorBoiler.getValue(false).filteredValue : NAN, now);
+  data.boiler_on = boiler_on;
+  sensorsControlTemp(&data, now);
+
+  _sensorsSnapshot[data.cycle & 1] = data;
+  __atomic_store_n(&_sensorsSnapshotVer, data.cycle, __ATOMIC_RELEASE);
+}
+
+uint32_t sensorsSnapshotGet(sensors_snapshot_t* snapshot)
+{
+  // Повтор нужен, только если за время копирования (микросекунды) писатель успел опубликовать новый цикл 
+  // и мог начать заполнять скопированный слот; это случается не чаще одного раза за цикл опроса (секунды)
+  uint32_t ver1, ver2;
+  do {
+    ver1 = __atomic_load_n(&_sensorsSnapshotVer, __ATOMIC_ACQUIRE);
+    *snapshot = _sensorsSnapshot[ver1 & 1];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    ver2 = __atomic_load_n(&_sensorsSnapshotVer, __ATOMIC_RELAXED);
+  } while (ver1 != ver2);
+  return snapshot->cycle;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------ Публикация по изменению ----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Величины сенсоров: настройки задаются параметрами, состояние изменяет только задача сенсоров
+static deadband_item_t _dbOutdoorTemp;
+static deadband_item_t _dbOutdoorHum;
+static deadband_item_t _dbIndoorTemp;
+static deadband_item_t _dbIndoorPress;
+static deadband_item_t _dbBoilerTemp;
+
+static deadband_item_t* const _dbOutdoor[] = { &_dbOutdoorTemp, &_dbOutdoorHum };
+static deadband_item_t* const _dbIndoor[] = { &_dbIndoorTemp, &_dbIndoorPress };
+static deadband_item_t* const _dbBoiler[] = { &_dbBoilerTemp };
+static deadband_item_t* const _dbAll[] = { &_dbOutdoorTemp, &_dbOutdoorHum, &_dbIndoorTemp, &_dbIndoorPress, &_dbBoilerTemp };
+#define SENSORS_DB_COUNT(items) (sizeof(items) / sizeof(items[0]))
+
+// Последние отправленные данные для каждого получателя (только задача сенсоров)
+static deadband_report_t _reportMqttOutdoor;
+static deadband_report_t _reportMqttIndoor;
+static deadband_report_t _reportMqttBoiler;
+#if CONFIG_OPENMON_ENABLE
+static deadband_report_t _reportOpenMon;
+#endif // CONFIG_OPENMON_ENABLE
+#if CONFIG_NARODMON_ENABLE
+static deadband_report_t _reportNarodMon;
+#endif // CONFIG_NARODMON_ENABLE
+#if CONFIG_THINGSPEAK_ENABLE
+static deadband_report_t _reportThingSpeak;
+#endif // CONFIG_THINGSPEAK_ENABLE
+
+// После подключения к брокеру все данные публикуются заново: флаг устанавливается в задаче цикла событий, 
+// а отчеты и флаги публикации сводок сбрасывает задача сенсоров
+static bool _mqttReportsReset = false;
+
+static void sensorsDeadbandInit()
+{
+  deadbandInit(&_dbOutdoorTemp, SENSORS_DEADBAND_OUTDOOR_TEMP_KEY, SENSORS_DEADBAND_OUTDOOR_TEMP_FRIENDLY, SENSORS_DEADBAND_OUTDOOR_TEMP);
+  deadbandInit(&_dbOutdoorHum, SENSORS_DEADBAND_OUTDOOR_HUM_KEY, SENSORS_DEADBAND_OUTDOOR_HUM_FRIENDLY, SENSORS_DEADBAND_OUTDOOR_HUM);
+  deadbandInit(&_dbIndoorTemp, SENSORS_DEADBAND_INDOOR_TEMP_KEY, SENSORS_DEADBAND_INDOOR_TEMP_FRIENDLY, SENSORS_DEADBAND_INDOOR_TEMP);
+  deadbandInit(&_dbIndoorPress, SENSORS_DEADBAND_INDOOR_PRESS_KEY, SENSORS_DEADBAND_INDOOR_PRESS_FRIENDLY, SENSORS_DEADBAND_INDOOR_PRESS);
+  deadbandInit(&_dbBoilerTemp, SENSORS_DEADBAND_BOILER_TEMP_KEY, SENSORS_DEADBAND_BOILER_TEMP_FRIENDLY, SENSORS_DEADBAND_BOILER_TEMP);
+
+  deadbandReportReset(&_reportMqttOutdoor);
+  deadbandReportReset(&_reportMqttIndoor);
+  deadbandReportReset(&_reportMqttBoiler);
+  #if CONFIG_OPENMON_ENABLE
+    deadbandReportReset(&_reportOpenMon);
+  #endif // CONFIG_OPENMON_ENABLE
+  #if CONFIG_NARODMON_ENABLE
+    deadbandReportReset(&_reportNarodMon);
+  #endif // CONFIG_NARODMON_ENABLE
+  #if CONFIG_THINGSPEAK_ENABLE
+    deadbandReportReset(&_reportThingSpeak);
+  #endif // CONFIG_THINGSPEAK_ENABLE
+}
+
+// Очередные показания; возвращает true, если хотя бы одна величина меняется достаточно быстро для частого опроса
+static bool sensorsDeadbandUpdate(const sensors_snapshot_t* data, int64_t now)
+{
+  deadbandUpdate(&_dbOutdoorTemp, data->outdoor_temp, now);
+  deadbandUpdate(&_dbOutdoorHum, data->outdoor_hum, now);
+  deadbandUpdate(&_dbIndoorTemp, data->indoor_temp, now);
+  deadbandUpdate(&_dbIndoorPress, data->indoor_press, now);
+  deadbandUpdate(&_dbBoilerTemp, data->boiler_temp, now);
+
+  bool fast = false;
+  for (uint8_t i = 0; i < SENSORS_DB_COUNT(_dbAll); i++) {
+    if (deadbandIsFast(_dbAll[i])) {
+      rlog_d(logTAG, "Fast change of [ %s ]: %.2f per minute", _dbAll[i]->key, _dbAll[i]->rate);
+      fast = true;
+    };
+  };
+  return fast;
+}
 
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------------------ Термостат ------------------------------------------------------
@@ -72,32 +294,263 @@ void sensorsInitRelays()
   #endif // CONFIG_ELTARIFFS_ENABLED
   lcBoiler.countersNvsRestore();
   lcBoiler.loadInit(false);
+  thermoModelInit();
+  heatStatInit();
 }
 
-bool sensorsBoilerTempCheck()
+bool sensorsBoilerTempCheck(float setpoint, float hysteresis)
 {
   // Получаем текущее состояние нагрузки
   bool oldState = lcBoiler.getState();
 
-  // Получаем текущую температуру с сенсора (она хранится во втором "хранилище") без физического чтения данных с шины
-  float tempIndoor = NAN;
-  if (sensorIndoor.getStatus() == SENSOR_STATUS_OK) {
-    tempIndoor = sensorIndoor.getValue2(false).filteredValue;
-  };
+  // Получаем текущую температуру из последних опубликованных показаний
+  sensors_snapshot_t data;
+  sensorsSnapshotGet(&data);
+  float tempIndoor = data.control_temp;
 
   // Если удалось считать температуру, проверяем её в зависимости от текущего состояния нагрузки
   if (!isnan(tempIndoor)) {
     if (oldState) {
       // Сейчас котел включен. Выключить мы его должны, когда температура достигнет порогового + 1/2 гистерезиса
-      return tempIndoor < (thermostatInternalTemp + 0.5 * thermostatInternalHyst);
+      return tempIndoor < (setpoint + 0.5 * hysteresis);
     } else {
       // Сейчас котел выключен. Включить мы его должны, когда температура снизится до порогового - 1/2 гистерезиса
-      return tempIndoor < (thermostatInternalTemp - 0.5 * thermostatInternalHyst);
+      return tempIndoor < (setpoint - 0.5 * hysteresis);
     };
   };
   return false;
 }
 
+// Температуры для тепловой модели берутся из последних показаний: NAN, если сенсор неисправен
+void sensorsBoilerModelUpdate()
+{
+  sensors_snapshot_t data;
+  sensorsSnapshotGet(&data);
+  thermoModelUpdate(lcBoiler.getState(), data.indoor_temp, data.outdoor_temp, data.boiler_temp);
+}
+
+// Защита от замерзания: температура в доме неизвестна, котел поддерживает минимальную температуру теплоносителя.
+// Если неисправен и датчик теплоносителя, работа котла разрешается - его собственная автоматика не даст перегреться
+static bool sensorsBoilerFrostCheck(float tempFlow)
+{
+  if (isnan(tempFlow)) return true;
+  if (lcBoiler.getState()) {
+    return tempFlow < (CONTROL_THERMOSTAT_FROST_TEMP + CONTROL_THERMOSTAT_FROST_HYST);
+  };
+  return tempFlow < CONTROL_THERMOSTAT_FROST_TEMP;
+}
+
+bool sensorsBoilerPredictCheck(float setpoint, float hysteresis)
+{
+  sensors_snapshot_t data;
+  sensorsSnapshotGet(&data);
+  if (!isnan(data.control_temp)) {
+    return thermoModelDecide(lcBoiler.getState(), data.control_temp, data.outdoor_temp, data.boiler_temp,
+      setpoint - 0.5 * hysteresis, setpoint + 0.5 * hysteresis,
+      thermostatInertia);
+  };
+  return false;
+}
+
+// Защита котла от частых включений: минимальное время работы и простоя, лимит запусков в час
+typedef struct {
+  int64_t last_switch;                          // Время последнего переключения, мкс (0 - не было с момента запуска)
+  uint32_t starts[CONTROL_THERMOSTAT_STARTS_LIMIT]; // Кольцевой буфер времени запусков, секунд
+  uint8_t starts_head;
+  bool blocked;                                 // Текущий запрос на переключение уже учтен как подавленный
+  uint32_t suppressed_on;                       // Включение отложено: не истекло минимальное время простоя
+  uint32_t suppressed_off;                      // Выключение отложено: не истекло минимальное время работы
+  uint32_t suppressed_budget;                   // Включение отложено: исчерпан лимит запусков в час
+  bool changed;
+} boiler_guard_t;
+
+static boiler_guard_t _boilerGuard;
+
+// Топики сводок создаются и освобождаются в задаче цикла событий, а используются в задаче сенсоров - только 
+// под _sensorsTopicMux: публикация работает с копией строки
+#define SENSORS_TOPIC_SIZE 128
+static portMUX_TYPE _sensorsTopicMux = portMUX_INITIALIZER_UNLOCKED;
+static char* _boilerGuardTopic = nullptr;
+static char* _heatStatTopic = nullptr;
+static bool _heatStatPending = false;
+static char* _healthTopic = nullptr;
+
+// Количество запусков котла за последний час
+static uint8_t sensorsBoilerStartsLastHour(uint32_t now_s)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < CONTROL_THERMOSTAT_STARTS_LIMIT; i++) {
+    if ((_boilerGuard.starts[i] > 0) && ((now_s - _boilerGuard.starts[i]) < 3600)) count++;
+  };
+  return count;
+}
+
+static void sensorsBoilerGuardSuppress(uint32_t* counter, const char* reason)
+{
+  // Повторные запросы того же переключения на следующих циклах не считаются
+  if (!_boilerGuard.blocked) {
+    _boilerGuard.blocked = true;
+    _boilerGuard.changed = true;
+    (*counter)++;
+    rlog_w(logTAG, "Boiler switching postponed: %s", reason);
+  };
+}
+
+// Фильтр перед реле котла: возвращает состояние, которое можно установить сейчас
+static bool sensorsBoilerGuard(bool newState)
+{
+  bool oldState = lcBoiler.getState();
+  if (newState == oldState) {
+    _boilerGuard.blocked = false;
+    return newState;
+  };
+
+  int64_t now = esp_timer_get_time();
+  uint32_t now_s = (uint32_t)(now / 1000000);
+  if (_boilerGuard.last_switch > 0) {
+    uint32_t held = (uint32_t)((now - _boilerGuard.last_switch) / 1000000);
+    if (oldState && (held < thermostatMinOn)) {
+      sensorsBoilerGuardSuppress(&_boilerGuard.suppressed_off, "minimum on time");
+      return oldState;
+    };
+    if (!oldState && (held < thermostatMinOff)) {
+      sensorsBoilerGuardSuppress(&_boilerGuard.suppressed_on, "minimum off time");
+      return oldState;
+    };
+  };
+  if (newState && (thermostatMaxStarts > 0) && (sensorsBoilerStartsLastHour(now_s) >= thermostatMaxStarts)) {
+    sensorsBoilerGuardSuppress(&_boilerGuard.suppressed_budget, "starts per hour limit");
+    return oldState;
+  };
+
+  // Переключение разрешено
+  _boilerGuard.blocked = false;
+  _boilerGuard.last_switch = now;
+  if (newState) {
+    _boilerGuard.starts[_boilerGuard.starts_head] = now_s > 0 ? now_s : 1;
+    _boilerGuard.starts_head = (_boilerGuard.starts_head + 1) % CONTROL_THERMOSTAT_STARTS_LIMIT;
+  };
+  return newState;
+}
+
+// Замена топика под блокировкой, старая строка освобождается уже вне критической секции
+static void sensorsTopicSet(char** slot, char* topic)
+{
+  portENTER_CRITICAL(&_sensorsTopicMux);
+  char* old = *slot;
+  *slot = topic;
+  portEXIT_CRITICAL(&_sensorsTopicMux);
+  if (old) free(old);
+}
+
+// Копия топика для публикации: false, если топик еще не создан
+static bool sensorsTopicGet(char* const* slot, char* buf, size_t size)
+{
+  memset(buf, 0, size);
+  portENTER_CRITICAL(&_sensorsTopicMux);
+  if (*slot) strncpy(buf, *slot, size - 1);
+  portEXIT_CRITICAL(&_sensorsTopicMux);
+  return buf[0] != 0;
+}
+
+static void sensorsBoilerGuardPublish()
+{
+  char topic[SENSORS_TOPIC_SIZE];
+  if (sensorsTopicGet(&_boilerGuardTopic, topic, sizeof(topic))) {
+    char* json = nullptr;
+    if (scratchAppendf(&_sensorsScratch, &json, nullptr, 
+        "{\"suppressed_on\":%" PRIu32 ",\"suppressed_off\":%" PRIu32 ",\"suppressed_budget\":%" PRIu32 ",\"starts_hour\":%d}",
+        _boilerGuard.suppressed_on, _boilerGuard.suppressed_off, _boilerGuard.suppressed_budget,
+        sensorsBoilerStartsLastHour((uint32_t)(esp_timer_get_time() / 1000000)))) {
+      mqttPublish(topic, json, CONTROL_THERMOSTAT_QOS, CONTROL_THERMOSTAT_RETAINED, false, false);
+      _boilerGuard.changed = false;
+    };
+  };
+}
+
+// Сводка аналитики отопления: раз в час и после подключения к брокеру
+static void sensorsHeatStatPublish()
+{
+  char topic[SENSORS_TOPIC_SIZE];
+  if (sensorsTopicGet(&_heatStatTopic, topic, sizeof(topic))) {
+    char* json = heatStatGetJson(&_sensorsScratch);
+    if (json) {
+      mqttPublish(topic, json, CONTROL_THERMOSTAT_QOS, CONTROL_THERMOSTAT_RETAINED, false, false);
+      _heatStatPending = false;
+    };
+  };
+}
+
+// Исправность источников температуры: при изменении состояния и вместе со статистикой котла
+static void sensorsHealthPublish()
+{
+  char topic[SENSORS_TOPIC_SIZE];
+  if (sensorsTopicGet(&_healthTopic, topic, sizeof(topic))) {
+    char faults[32];
+    char* json = nullptr;
+    bool ok = scratchAppendf(&_sensorsScratch, &json, nullptr, "{\"source\":%d,\"control_temp\":%.2f", 
+      (int)_controlSource, (_controlSource == SENSORS_SOURCE_NONE) || isnan(_fallbackTemp) ? 0.0 : _fallbackTemp);
+    const char* topics[] = { SENSOR_OUTDOOR_TOPIC, SENSOR_INDOOR_TOPIC, SENSOR_BOILER_TOPIC };
+    const sens_health_t* items[] = { &_healthOutdoor, &_healthIndoor, &_healthBoiler };
+    for (uint8_t i = 0; ok && (i < 3); i++) {
+      ok = scratchAppendf(&_sensorsScratch, &json, ",", "\"%s\":{\"healthy\":%d,\"score\":%u,\"faults\":\"%s\",\"errors\":%" PRIu32 "}",
+        topics[i], items[i]->healthy ? 1 : 0, (unsigned)items[i]->score, 
+        sensHealthFaultsStr(items[i]->faults, faults, sizeof(faults)), items[i]->fault_counts);
+    };
+    if (ok && scratchAppendf(&_sensorsScratch, &json, nullptr, "}")) {
+      mqttPublish(topic, json, CONTROL_THERMOSTAT_QOS, CONTROL_THERMOSTAT_RETAINED, false, false);
+      _healthChanged = false;
+    };
+  };
+}
+
+// Состояние суточного расписания термостата: вычисляется модулем timesched только в моменты переключения
+static bool sensorsThermostatTimespan()
+{
+  if (_thermostatSchedule != TIMESCHED_NONE) {
+    return timeSchedGetState(_thermostatSchedule);
+  };
+  return checkTimespanNowEx(thermostatTimespan, true);
+}
+
+// Уставка по недельному расписанию: уставка активного периода или основная уставка термостата вне периодов.
+// Перед началом периода с более высокой уставкой она применяется заранее - за время предварительного нагрева
+// или за прогнозируемое тепловой моделью время нагрева с учетом инерции системы, если оно меньше
+static void sensorsThermostatPlan(float* setpoint, float* hysteresis)
+{
+  *setpoint = thermostatInternalTemp;
+  *hysteresis = thermostatInternalHyst;
+
+  heat_plan_state_t plan;
+  if (heatPlanLookup(time(nullptr), &plan)) {
+    if (plan.period != HEATPLAN_NONE) {
+      *setpoint = plan.temp;
+      *hysteresis = plan.hyst;
+    };
+    if ((plan.next != HEATPLAN_NONE) && (plan.next_preheat > 0) && (plan.next_temp > *setpoint)) {
+      uint32_t lead = (uint32_t)plan.next_preheat * 60;
+      if (thermoModelReady()) {
+        sensors_snapshot_t data;
+        sensorsSnapshotGet(&data);
+        int32_t estimate = thermoModelTimeTo(true, data.control_temp, data.outdoor_temp, data.boiler_temp, plan.next_temp);
+        if ((estimate >= 0) && (((uint32_t)estimate + thermostatInertia) < lead)) {
+          lead = (uint32_t)estimate + thermostatInertia;
+        };
+      };
+      if (plan.next_in <= lead) {
+        plan.period = plan.next;
+        *setpoint = plan.next_temp;
+        *hysteresis = plan.next_hyst;
+      };
+    };
+  };
+
+  if (plan.period != _thermostatPeriod) {
+    _thermostatPeriod = plan.period;
+    rlog_i(logTAG, "Heating schedule: period %d, setpoint %.2f, hysteresis %.2f", plan.period + 1, *setpoint, *hysteresis);
+  };
+}
+
 void sensorsBoilerControl()
 {
   bool newState;
@@ -112,22 +565,60 @@ void sensorsBoilerControl()
   } 
   // Только управление по расписанию (без учета температуры)
   else if (thermostatMode == THERMOSTAT_TIME) {
-    newState = checkTimespanNowEx(thermostatTimespan, true);
+    newState = sensorsThermostatTimespan();
   } 
   // Только управление по температуре (без учета расписания)
   else if (thermostatMode == THERMOSTAT_TEMP) {
-    newState = sensorsBoilerTempCheck();
+    newState = sensorsBoilerTempCheck(thermostatInternalTemp, thermostatInternalHyst);
   } 
   // Управление по расписанию и температуре одновременно
   else if (thermostatMode == THERMOSTAT_TIME_AND_TEMP) {
-    newState = checkTimespanNowEx(thermostatTimespan, true) && sensorsBoilerTempCheck();
+    newState = sensorsThermostatTimespan() && sensorsBoilerTempCheck(thermostatInternalTemp, thermostatInternalHyst);
+  } 
+  // Управление по прогнозу тепловой модели дома (без учета расписания)
+  else if (thermostatMode == THERMOSTAT_PREDICT) {
+    newState = sensorsBoilerPredictCheck(thermostatInternalTemp, thermostatInternalHyst);
+  } 
+  // Управление по расписанию и прогнозу тепловой модели дома
+  else if (thermostatMode == THERMOSTAT_TIME_AND_PREDICT) {
+    newState = sensorsThermostatTimespan() && sensorsBoilerPredictCheck(thermostatInternalTemp, thermostatInternalHyst);
+  } 
+  // Управление по температуре с уставками недельного расписания
+  else if (thermostatMode == THERMOSTAT_PLAN) {
+    float setpoint, hysteresis;
+    sensorsThermostatPlan(&setpoint, &hysteresis);
+    newState = sensorsBoilerTempCheck(setpoint, hysteresis);
+  } 
+  // Управление по прогнозу тепловой модели с уставками недельного расписания
+  else if (thermostatMode == THERMOSTAT_PLAN_PREDICT) {
+    float setpoint, hysteresis;
+    sensorsThermostatPlan(&setpoint, &hysteresis);
+    newState = sensorsBoilerPredictCheck(setpoint, hysteresis);
   } 
   // Защита от ошибки программиста (а вдруг вы добавили еще режим и забыли написать обработчик?)
   else {
     newState = false;
   };
 
-  // Применяем новое состояние
+  // В режимах с учетом температуры при отсутствии исправного источника температуры в доме включается защита 
+  // от замерзания - независимо от расписания
+  if ((thermostatMode != THERMOSTAT_OFF) && (thermostatMode != THERMOSTAT_ON) && (thermostatMode != THERMOSTAT_TIME)) {
+    sensors_snapshot_t data;
+    sensorsSnapshotGet(&data);
+    if ((data.cycle > 0) && (data.control_source == SENSORS_SOURCE_NONE)) {
+      newState = sensorsBoilerFrostCheck(data.boiler_temp);
+    };
+  };
+
+  // Применяем новое состояние; в автоматических режимах - с защитой от частых включений
+  if ((thermostatMode != THERMOSTAT_OFF) && (thermostatMode != THERMOSTAT_ON)) {
+    newState = sensorsBoilerGuard(newState);
+  } else {
+    _boilerGuard.blocked = false;
+    if (newState != lcBoiler.getState()) {
+      _boilerGuard.last_switch = esp_timer_get_time();
+    };
+  };
   lcBoiler.loadSetState(newState, false, true);
 }
 
@@ -161,6 +652,9 @@ static void sensorsMqttTopicsCreate(bool primary)
     rlog_i(logTAG, "Generated topic for boiler temperture control: [ %s ]", tempMonitorBoiler.mqttTopicGet());
   };
   lcBoiler.mqttTopicCreate(primary, CONTROL_THERMOSTAT_LOCAL, CONTROL_THERMOSTAT_BOILER_TOPIC, nullptr, nullptr);
+  sensorsTopicSet(&_boilerGuardTopic, mqttGetTopicDevice1(primary, CONTROL_THERMOSTAT_LOCAL, CONTROL_THERMOSTAT_GUARD_TOPIC));
+  sensorsTopicSet(&_heatStatTopic, mqttGetTopicDevice1(primary, CONTROL_THERMOSTAT_LOCAL, CONTROL_THERMOSTAT_STATS_TOPIC));
+  sensorsTopicSet(&_healthTopic, mqttGetTopicDevice1(primary, CONTROL_THERMOSTAT_LOCAL, CONTROL_THERMOSTAT_HEALTH_TOPIC));
 }
 
 static void sensorsMqttTopicsFree()
@@ -171,6 +665,9 @@ static void sensorsMqttTopicsFree()
   sensorBoiler.topicsFree();
   tempMonitorBoiler.mqttTopicFree();
   lcBoiler.mqttTopicFree();
+  sensorsTopicSet(&_boilerGuardTopic, nullptr);
+  sensorsTopicSet(&_heatStatTopic, nullptr);
+  sensorsTopicSet(&_healthTopic, nullptr);
   rlog_d(logTAG, "Topics for temperture control has been scrapped");
 }
 
@@ -219,6 +716,8 @@ static void sensorsStoreData()
   tempMonitorBoiler.nvsStore(CONTROL_TEMP_BOILER_KEY);
 
   lcBoiler.countersNvsStore();
+  thermoModelStore();
+  heatStatStore();
 }
 
 static void sensorsInitParameters()
@@ -259,6 +758,26 @@ static void sensorsInitParameters()
     #endif // CONFIG_THINGSPEAK_ENABLE
   };
 
+  // Пороги публикации по изменению и частого опроса для каждой величины
+  paramsGroupHandle_t pgDeadband = paramsRegisterGroup(pgSensors, 
+    SENSORS_DEADBAND_PGROUP_KEY, SENSORS_DEADBAND_PGROUP_TOPIC, SENSORS_DEADBAND_PGROUP_FRIENDLY);
+  if (pgDeadband) {
+    for (uint8_t i = 0; i < SENSORS_DB_COUNT(_dbAll); i++) {
+      paramsGroupHandle_t pgItem = paramsRegisterGroup(pgDeadband, _dbAll[i]->key, _dbAll[i]->key, _dbAll[i]->friendly);
+      if (pgItem) {
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgItem,
+          SENSORS_DEADBAND_DELTA_KEY, SENSORS_DEADBAND_DELTA_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_dbAll[i]->delta);
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgItem,
+          SENSORS_DEADBAND_SLOPE_KEY, SENSORS_DEADBAND_SLOPE_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_dbAll[i]->slope);
+        paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_FLOAT, nullptr, pgItem,
+          SENSORS_DEADBAND_FAST_KEY, SENSORS_DEADBAND_FAST_FRIENDLY,
+          CONFIG_MQTT_PARAMS_QOS, (void*)&_dbAll[i]->fast_slope);
+      };
+    };
+  };
+
   // Параметры термостата
   if (pgThermostat) {
     paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgThermostat,
@@ -276,6 +795,35 @@ static void sensorsInitParameters()
     paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgThermostat,
       CONTROL_THERMOSTAT_PARAM_NOTIFY_KEY, CONTROL_THERMOSTAT_PARAM_NOTIFY_FRIENDLY,
       CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatNotify);
+    paramsSetLimitsU32(
+      paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgThermostat,
+        CONTROL_THERMOSTAT_PARAM_INERTIA_KEY, CONTROL_THERMOSTAT_PARAM_INERTIA_FRIENDLY,
+        CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatInertia),
+      0, 7200);
+    paramsSetLimitsU32(
+      paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgThermostat,
+        CONTROL_THERMOSTAT_PARAM_MINON_KEY, CONTROL_THERMOSTAT_PARAM_MINON_FRIENDLY,
+        CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatMinOn),
+      0, 3600);
+    paramsSetLimitsU32(
+      paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U32, nullptr, pgThermostat,
+        CONTROL_THERMOSTAT_PARAM_MINOFF_KEY, CONTROL_THERMOSTAT_PARAM_MINOFF_FRIENDLY,
+        CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatMinOff),
+      0, 3600);
+    paramsSetLimitsU8(
+      paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgThermostat,
+        CONTROL_THERMOSTAT_PARAM_STARTS_KEY, CONTROL_THERMOSTAT_PARAM_STARTS_FRIENDLY,
+        CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatMaxStarts),
+      0, CONTROL_THERMOSTAT_STARTS_LIMIT);
+    paramsRegisterValue(OPT_KIND_PARAMETER, OPT_TYPE_U8, nullptr, pgThermostat,
+      CONTROL_THERMOSTAT_PARAM_FALLBACK_KEY, CONTROL_THERMOSTAT_PARAM_FALLBACK_FRIENDLY,
+      CONFIG_MQTT_PARAMS_QOS, (void*)&thermostatFallback);
+
+    // Недельное расписание с уставками по периодам
+    heatPlanRegisterParameters(pgThermostat);
+
+    // Мощность котла и стоимость энергии для аналитики отопления
+    heatStatRegisterParameters(pgThermostat);
   };
 }
 
@@ -340,9 +888,9 @@ static void sensorsInitSensors()
       CONFIG_FORMAT_TIMESTAMP_S, CONFIG_FORMAT_TSVALUE
     #endif // CONFIG_SENSOR_TIMESTRING_ENABLE
   );
-  sensorIndoor.initExtItems(SENSOR_INDOOR_NAME, SENSOR_INDOOR_TOPIC, false,
+  sensorIndoor.initStream(SENSOR_INDOOR_NAME, SENSOR_INDOOR_TOPIC, false,
     SENSOR_INDOOR_BUS, SENSOR_INDOOR_ADDRESS, 
-    BME280_MODE_FORCED, BME280_STANDBY_1000ms, BME280_FLT_NONE, BME280_OSM_X4, BME280_OSM_X4, BME280_OSM_X4,
+    SENSOR_INDOOR_STANDBY, SENSOR_INDOOR_IIR_FILTER, BME280_OSM_X4, BME280_OSM_X4, BME280_OSM_X4,
     &siIndoorPress, &siIndoorTemp, &siIndoorHum, 
     3000, SENSOR_INDOOR_ERRORS_LIMIT, nullptr, sensorsPublish);
   sensorIndoor.registerParameters(pgSensors, SENSOR_INDOOR_KEY, SENSOR_INDOOR_TOPIC, SENSOR_INDOOR_NAME);
@@ -387,6 +935,7 @@ static void sensorsMqttEventHandler(void* arg, esp_event_base_t event_base, int3
   if (event_id == RE_MQTT_CONNECTED) {
     re_mqtt_event_data_t* data = (re_mqtt_event_data_t*)event_data;
     sensorsMqttTopicsCreate(data->primary);
+    __atomic_store_n(&_mqttReportsReset, true, __ATOMIC_RELEASE);
   } 
   // MQTT disconnected
   else if ((event_id == RE_MQTT_CONN_LOST) || (event_id == RE_MQTT_CONN_FAILED)) {
@@ -536,12 +1085,9 @@ static void sensorsCommandsEventHandler(void* arg, esp_event_base_t event_base,
 static void sensorsOtaEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
   if ((event_id == RE_SYS_OTA) && (event_data)) {
+    // Во время OTA сенсоры продолжают опрашиваться и управлять котлом, приостанавливается только отправка данных
     re_system_event_data_t* data = (re_system_event_data_t*)event_data;
-    if (data->type == RE_SYS_SET) {
-      sensorsTaskSuspend();
-    } else {
-      sensorsTaskResume();
-    };
+    _sensorsOtaActive = (data->type == RE_SYS_SET);
   };
 }
 
@@ -564,17 +1110,20 @@ void sensorsTaskExec(void *pvParameters)
   // -------------------------------------------------------------------------------------------------------
   // Инициализация параметров
   // -------------------------------------------------------------------------------------------------------
+  sensorsDeadbandInit();
   sensorsInitParameters();
 
   // -------------------------------------------------------------------------------------------------------
   // Инициализация сенсоров 
   // -------------------------------------------------------------------------------------------------------
   sensorsInitSensors();
+  sensorsHealthInit();
 
   // -------------------------------------------------------------------------------------------------------
   // Инициализация термостата 
   // -------------------------------------------------------------------------------------------------------
   sensorsInitRelays();
+  _thermostatSchedule = timeSchedRegisterTimespan(&thermostatTimespan);
 
   // -------------------------------------------------------------------------------------------------------
   // Инициализация контроллеров
@@ -601,27 +1150,26 @@ void sensorsTaskExec(void *pvParameters)
   #endif // CONFIG_THINGSPEAK_ENABLE
 
   // -------------------------------------------------------------------------------------------------------
-  // Таймеры публикции данных с сенсоров
+  // Таймеры публикции данных с сенсоров (облачные сервисы - по изменению, см. sensorsDeadbandInit())
   // -------------------------------------------------------------------------------------------------------
   esp_timer_t mqttPubTimer;
   timerSet(&mqttPubTimer, iMqttPubInterval*1000);
-  #if CONFIG_OPENMON_ENABLE
-    esp_timer_t omSendTimer;
-    timerSet(&omSendTimer, iOpenMonInterval*1000);
-  #endif // CONFIG_OPENMON_ENABLE
-  #if CONFIG_NARODMON_ENABLE
-    esp_timer_t nmSendTimer;
-    timerSet(&nmSendTimer, iNarodMonInterval*1000);
-  #endif // CONFIG_NARODMON_ENABLE
-  #if CONFIG_THINGSPEAK_ENABLE
-    esp_timer_t tsSendTimer;
-    timerSet(&tsSendTimer, iThingSpeakInterval*1000);
-  #endif // CONFIG_THINGSPEAK_ENABLE
+
+  scratchInit(&_sensorsScratch, _sensorsScratchBuf, sizeof(_sensorsScratchBuf));
+
+  // Метрики времени выполнения этапов цикла
+  perf_metric_t perfRead = perfRegister("sensors_read");
+  perf_metric_t perfControl = perfRegister("sensors_control");
+  perf_metric_t perfPublish = perfRegister("sensors_publish");
+
+  // Адаптивный период опроса
+  int64_t fastUntil = 0;
 
   while (1) {
     // -----------------------------------------------------------------------------------------------------
     // Чтение данных с сенсоров
     // -----------------------------------------------------------------------------------------------------
+    int64_t perfStart = esp_timer_get_time();
     sensorOutdoor.readData();
     if (sensorOutdoor.getStatus() == SENSOR_STATUS_OK) {
       rlog_i("OUTDOOR", "Values raw: %.2f °С / %.2f %% | out: %.2f °С / %.2f %% | min: %.2f °С / %.2f %% | max: %.2f °С / %.2f %%", 
@@ -646,19 +1194,40 @@ void sensorsTaskExec(void *pvParameters)
         sensorBoiler.getExtremumsDaily(false).minValue.filteredValue,
         sensorBoiler.getExtremumsDaily(false).maxValue.filteredValue);
     };
+    sensorsSnapshotPublish(lcBoiler.getState());
+    perfRecord(perfRead, (uint32_t)(esp_timer_get_time() - perfStart));
+
+    // Все дальнейшие проверки и отправки в этом цикле используют один и тот же набор показаний
+    sensors_snapshot_t readings;
+    sensorsSnapshotGet(&readings);
+
+    // При быстром изменении любой величины переходим на частый опрос
+    int64_t now = esp_timer_get_time();
+    if (sensorsDeadbandUpdate(&readings, now)) {
+      if (now >= fastUntil) {
+        rlog_i(logTAG, "Fast change detected, switching to fast polling");
+      };
+      fastUntil = now + (int64_t)SENSORS_FAST_HOLD * 1000;
+    };
 
     // -----------------------------------------------------------------------------------------------------
     // Контроль температуры
     // -----------------------------------------------------------------------------------------------------
 
+    perfStart = esp_timer_get_time();
+    sensorsBoilerModelUpdate();
     sensorsBoilerControl();
+    if (heatStatUpdate(lcBoiler.getState(), readings.indoor_temp, readings.outdoor_temp, readings.boiler_temp)) {
+      _heatStatPending = true;
+    };
 
-    if (sensorIndoor.getStatus() == SENSOR_STATUS_OK) {
-      tempMonitorIndoor.checkValue(sensorIndoor.getValue2(false).filteredValue);
+    if (!isnan(readings.indoor_temp)) {
+      tempMonitorIndoor.checkValue(readings.indoor_temp);
     };
-    if (sensorBoiler.getStatus() == SENSOR_STATUS_OK) {
-      tempMonitorBoiler.checkValue(sensorBoiler.getValue(false).filteredValue);
+    if (!isnan(readings.boiler_temp)) {
+      tempMonitorBoiler.checkValue(readings.boiler_temp);
     };
+    perfRecord(perfControl, (uint32_t)(esp_timer_get_time() - perfStart));
 
     // -----------------------------------------------------------------------------------------------------
     // Сохранение данных сенсоров
@@ -673,116 +1242,139 @@ void sensorsTaskExec(void *pvParameters)
     // Публикация данных с сенсоров
     // -----------------------------------------------------------------------------------------------------
 
-    // MQTT брокер
-    if (esp_heap_free_check() && statesMqttIsConnected() && timerTimeout(&mqttPubTimer)) {
-      timerSet(&mqttPubTimer, iMqttPubInterval*1000);
-      sensorOutdoor.publishData(false);
-      sensorIndoor.publishData(false);
-      tempMonitorIndoor.mqttPublish();
-      sensorBoiler.publishData(false);
-      tempMonitorBoiler.mqttPublish();
-      lcBoiler.mqttPublish();
+    // Строки прошлого цикла уже переданы (mqttPublish и dsSend копируют данные)
+    scratchReset(&_sensorsScratch);
+
+    // MQTT брокер: данные каждого сенсора публикуются при выходе за порог изменения, но не реже iMqttPubInterval
+    if (__atomic_exchange_n(&_mqttReportsReset, false, __ATOMIC_ACQ_REL)) {
+      deadbandReportReset(&_reportMqttOutdoor);
+      deadbandReportReset(&_reportMqttIndoor);
+      deadbandReportReset(&_reportMqttBoiler);
+      _boilerGuard.changed = true;
+      _heatStatPending = true;
+      _healthChanged = true;
+    };
+    if (!_sensorsOtaActive && esp_heap_free_check() && statesMqttIsConnected()) {
+      perfStart = esp_timer_get_time();
+      bool published = false;
+      if (deadbandReportCheck(&_reportMqttOutdoor, _dbOutdoor, SENSORS_DB_COUNT(_dbOutdoor), perfStart, iMqttPubInterval, 0)) {
+        sensorOutdoor.publishData(false);
+        published = true;
+      };
+      if (deadbandReportCheck(&_reportMqttIndoor, _dbIndoor, SENSORS_DB_COUNT(_dbIndoor), perfStart, iMqttPubInterval, 0)) {
+        sensorIndoor.publishData(false);
+        tempMonitorIndoor.mqttPublish();
+        published = true;
+      };
+      if (deadbandReportCheck(&_reportMqttBoiler, _dbBoiler, SENSORS_DB_COUNT(_dbBoiler), perfStart, iMqttPubInterval, 0)) {
+        sensorBoiler.publishData(false);
+        tempMonitorBoiler.mqttPublish();
+        published = true;
+      };
+      // Статистика котла публикуется с прежним периодом, изменения состояния котел отправляет сам
+      if (timerTimeout(&mqttPubTimer)) {
+        timerSet(&mqttPubTimer, iMqttPubInterval*1000);
+        lcBoiler.mqttPublish();
+        sensorsBoilerGuardPublish();
+        sensorsHealthPublish();
+        published = true;
+      } else {
+        if (_boilerGuard.changed) {
+          sensorsBoilerGuardPublish();
+          published = true;
+        };
+        if (_healthChanged) {
+          sensorsHealthPublish();
+          published = true;
+        };
+      };
+      if (_heatStatPending) {
+        sensorsHeatStatPublish();
+        published = true;
+      };
+      if (published) {
+        perfRecord(perfPublish, (uint32_t)(esp_timer_get_time() - perfStart));
+      };
     };
 
     // open-monitoring.online
     #if CONFIG_OPENMON_ENABLE
-      if (statesInetIsAvailabled() && timerTimeout(&omSendTimer)) {
-        timerSet(&omSendTimer, iOpenMonInterval*1000);
+      if (!_sensorsOtaActive && statesInetIsAvailabled() 
+       && deadbandReportCheck(&_reportOpenMon, _dbAll, SENSORS_DB_COUNT(_dbAll), esp_timer_get_time(), iOpenMonInterval, SENSORS_OPENMON_HOLDOFF)) {
         char * omValues = nullptr;
         // Улица
-        if (sensorOutdoor.getStatus() == SENSOR_STATUS_OK) {
-          omValues = concat_strings_div(omValues, 
-            malloc_stringf("p1=%.3f&p2=%.2f", 
-              sensorOutdoor.getValue2(false).filteredValue, sensorOutdoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.outdoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &omValues, "&", "p1=%.3f&p2=%.2f", 
+            readings.outdoor_temp, readings.outdoor_hum);
         };
         // Комната
-        if (sensorIndoor.getStatus() == SENSOR_STATUS_OK) {
-          omValues = concat_strings_div(omValues, 
-            malloc_stringf("p3=%.3f&p4=%.2f", 
-              sensorIndoor.getValue2(false).filteredValue, sensorIndoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.indoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &omValues, "&", "p3=%.3f&p4=%.2f", 
+            readings.indoor_temp, readings.indoor_press);
         };
         // Котёл
-        if (sensorBoiler.getStatus() == SENSOR_STATUS_OK) {
-          omValues = concat_strings_div(omValues, 
-            malloc_stringf("p5=%.3f", 
-              sensorBoiler.getValue(false).filteredValue),
-            "&");
+        if (!isnan(readings.boiler_temp)) {
+          scratchAppendf(&_sensorsScratch, &omValues, "&", "p5=%.3f", 
+            readings.boiler_temp);
         };
         // Отправляем данные
         if (omValues) {
           dsSend(EDS_OPENMON, CONFIG_OPENMON_CTR01_ID, omValues, false); 
-          free(omValues);
         };
       };
     #endif // CONFIG_OPENMON_ENABLE
 
     // narodmon.ru
     #if CONFIG_NARODMON_ENABLE
-      if (statesInetIsAvailabled() && timerTimeout(&nmSendTimer)) {
-        timerSet(&nmSendTimer, iNarodMonInterval*1000);
+      if (!_sensorsOtaActive && statesInetIsAvailabled() 
+       && deadbandReportCheck(&_reportNarodMon, _dbAll, SENSORS_DB_COUNT(_dbAll), esp_timer_get_time(), iNarodMonInterval, SENSORS_NARODMON_HOLDOFF)) {
         char * nmValues = nullptr;
         // Улица
-        if (sensorOutdoor.getStatus() == SENSOR_STATUS_OK) {
-          nmValues = concat_strings_div(nmValues, 
-            malloc_stringf("Tout=%.2f&Hout=%.2f", 
-              sensorOutdoor.getValue2(false).filteredValue, sensorOutdoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.outdoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &nmValues, "&", "Tout=%.2f&Hout=%.2f", 
+            readings.outdoor_temp, readings.outdoor_hum);
         };
         // Комната
-        if (sensorIndoor.getStatus() == SENSOR_STATUS_OK) {
-          nmValues = concat_strings_div(nmValues, 
-            malloc_stringf("Tin=%.2f&Hin=%.2f", 
-              sensorIndoor.getValue2(false).filteredValue, sensorIndoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.indoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &nmValues, "&", "Tin=%.2f&Hin=%.2f", 
+            readings.indoor_temp, readings.indoor_press);
         };
         // Котёл
-        if (sensorBoiler.getStatus() == SENSOR_STATUS_OK) {
-          nmValues = concat_strings_div(nmValues, 
-            malloc_stringf("Tboiler=%.2f", 
-              sensorBoiler.getValue(false).filteredValue),
-            "&");
+        if (!isnan(readings.boiler_temp)) {
+          scratchAppendf(&_sensorsScratch, &nmValues, "&", "Tboiler=%.2f", 
+            readings.boiler_temp);
         };
         // Отправляем данные
         if (nmValues) {
           dsSend(EDS_NARODMON, CONFIG_NARODMON_DEVICE01_ID, nmValues, false); 
-          free(nmValues);
         };
       };
     #endif // CONFIG_NARODMON_ENABLE
 
     // thingspeak.com
     #if CONFIG_THINGSPEAK_ENABLE
-      if (statesInetIsAvailabled() && timerTimeout(&tsSendTimer)) {
-        timerSet(&tsSendTimer, iThingSpeakInterval*1000);
+      if (!_sensorsOtaActive && statesInetIsAvailabled() 
+       && deadbandReportCheck(&_reportThingSpeak, _dbAll, SENSORS_DB_COUNT(_dbAll), esp_timer_get_time(), iThingSpeakInterval, SENSORS_THINGSPEAK_HOLDOFF)) {
 
         char * tsValues = nullptr;
         // Улица
-        if (sensorOutdoor.getStatus() == SENSOR_STATUS_OK) {
-          tsValues = concat_strings_div(tsValues, 
-            malloc_stringf("field1=%.3f&field2=%.2f", 
-              sensorOutdoor.getValue2(false).filteredValue, sensorOutdoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.outdoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &tsValues, "&", "field1=%.3f&field2=%.2f", 
+            readings.outdoor_temp, readings.outdoor_hum);
         };
         // Комната
-        if (sensorIndoor.getStatus() == SENSOR_STATUS_OK) {
-          tsValues = concat_strings_div(tsValues, 
-            malloc_stringf("field3=%.3f&field4=%.2f", 
-              sensorIndoor.getValue2(false).filteredValue, sensorIndoor.getValue1(false).filteredValue),
-            "&");
+        if (!isnan(readings.indoor_temp)) {
+          scratchAppendf(&_sensorsScratch, &tsValues, "&", "field3=%.3f&field4=%.2f", 
+            readings.indoor_temp, readings.indoor_press);
         };
         // Котёл
-        if (sensorBoiler.getStatus() == SENSOR_STATUS_OK) {
-          tsValues = concat_strings_div(tsValues, 
-            malloc_stringf("field5=%.3f", 
-              sensorBoiler.getValue(false).filteredValue),
-            "&");
+        if (!isnan(readings.boiler_temp)) {
+          scratchAppendf(&_sensorsScratch, &tsValues, "&", "field5=%.3f", 
+            readings.boiler_temp);
         };
         // Отправляем данные
         if (tsValues) {
           dsSend(EDS_THINGSPEAK, CONFIG_THINGSPEAK_CHANNEL01_ID, tsValues, false); 
-          free(tsValues);
         };
       };
     #endif // CONFIG_THINGSPEAK_ENABLE
@@ -790,7 +1382,7 @@ void sensorsTaskExec(void *pvParameters)
     // -----------------------------------------------------------------------------------------------------
     // Ожидание
     // -----------------------------------------------------------------------------------------------------
-    vTaskDelayUntil(&prevTicks, pdMS_TO_TICKS(CONFIG_SENSORS_TASK_CYCLE));
+    vTaskDelayUntil(&prevTicks, pdMS_TO_TICKS(esp_timer_get_time() < fastUntil ? SENSORS_TASK_CYCLE_FAST : CONFIG_SENSORS_TASK_CYCLE));
   };
 
   vTaskDelete(nullptr);
@@ -11,7 +11,11 @@
 #include "reSensor.h" 
 #include "reDHTxx.h"
 #include "reBME280.h"
+#include "bme280stream.h"
 #include "reDS18x20.h"
+#include "thermomodel.h"
+#include "senshealth.h"
+#include "deadband.h"
 
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------------------- Сенсоры -------------------------------------------------------
@@ -36,8 +40,11 @@ static DHTxx sensorOutdoor(1);
 #define SENSOR_INDOOR_FILTER_MODE SENSOR_FILTER_RAW
 #define SENSOR_INDOOR_FILTER_SIZE 0
 #define SENSOR_INDOOR_ERRORS_LIMIT 10
+// Датчик работает в режиме NORMAL: новое измерение каждую секунду, давление и температура сглаживаются встроенным IIR-фильтром
+#define SENSOR_INDOOR_STANDBY BME280_STANDBY_1000ms
+#define SENSOR_INDOOR_IIR_FILTER BME280_FLT_16
 
-static BME280 sensorIndoor(2);
+static BME280Stream sensorIndoor(2);
 
 // DS18B20: Теплоноситель
 #define SENSOR_BOILER_NAME "Котёл (DS18B20)"
@@ -64,6 +71,68 @@ static uint32_t iNarodMonInterval = CONFIG_NARODMON_SEND_INTERVAL;
 static uint32_t iThingSpeakInterval = CONFIG_THINGSPEAK_SEND_INTERVAL;
 #endif // CONFIG_THINGSPEAK_ENABLE
 
+// Публикация по изменению (модуль deadband): данные сенсора отправляются на MQTT сразу, как только одна из его величин
+// отклонилась от последнего опубликованного значения больше чем на delta или меняется быстрее slope (единиц в минуту).
+// Если изменений нет, данные отправляются не реже iMqttPubInterval. Облачные сервисы получают данные по тем же правилам,
+// но не чаще допустимого для сервиса интервала SENSORS_xxx_HOLDOFF и не реже заданного периода отправки.
+// При скорости изменения любой величины выше fast_slope сенсоры опрашиваются с периодом SENSORS_TASK_CYCLE_FAST 
+// в течение SENSORS_FAST_HOLD, иначе - с периодом CONFIG_SENSORS_TASK_CYCLE. Нулевой порог не проверяется.
+// Температура теплоносителя растет на несколько градусов в минуту при каждом розжиге горелки, поэтому для нее 
+// ни порог скорости, ни частый опрос по умолчанию не используются
+#define SENSORS_DEADBAND_PGROUP_KEY             "deadband"
+#define SENSORS_DEADBAND_PGROUP_TOPIC           "deadband"
+#define SENSORS_DEADBAND_PGROUP_FRIENDLY        "Публикация по изменению"
+
+#define SENSORS_DEADBAND_DELTA_KEY              "delta"
+#define SENSORS_DEADBAND_DELTA_FRIENDLY         "Порог изменения"
+#define SENSORS_DEADBAND_SLOPE_KEY              "slope"
+#define SENSORS_DEADBAND_SLOPE_FRIENDLY         "Порог скорости изменения, в минуту"
+#define SENSORS_DEADBAND_FAST_KEY               "fast_slope"
+#define SENSORS_DEADBAND_FAST_FRIENDLY          "Порог скорости для частого опроса, в минуту"
+
+// Значения по умолчанию: delta, slope, fast_slope
+#define SENSORS_DEADBAND_OUTDOOR_TEMP_KEY       "outdoor_temp"
+#define SENSORS_DEADBAND_OUTDOOR_TEMP_FRIENDLY  "Улица: температура"
+#define SENSORS_DEADBAND_OUTDOOR_TEMP           0.2, 0.0, 0.0
+#define SENSORS_DEADBAND_OUTDOOR_HUM_KEY        "outdoor_hum"
+#define SENSORS_DEADBAND_OUTDOOR_HUM_FRIENDLY   "Улица: влажность"
+#define SENSORS_DEADBAND_OUTDOOR_HUM            2.0, 0.0, 0.0
+#define SENSORS_DEADBAND_INDOOR_TEMP_KEY        "indoor_temp"
+#define SENSORS_DEADBAND_INDOOR_TEMP_FRIENDLY   "Комната: температура"
+#define SENSORS_DEADBAND_INDOOR_TEMP            0.2, 0.1, 0.1
+#define SENSORS_DEADBAND_INDOOR_PRESS_KEY       "indoor_press"
+#define SENSORS_DEADBAND_INDOOR_PRESS_FRIENDLY  "Комната: давление"
+#define SENSORS_DEADBAND_INDOOR_PRESS           0.5, 0.0, 0.0
+#define SENSORS_DEADBAND_BOILER_TEMP_KEY        "boiler_temp"
+#define SENSORS_DEADBAND_BOILER_TEMP_FRIENDLY   "Теплоноситель: температура"
+#define SENSORS_DEADBAND_BOILER_TEMP            1.0, 0.0, 0.0
+
+#define SENSORS_TASK_CYCLE_FAST                 10000
+#define SENSORS_FAST_HOLD                       300000
+
+// Минимальный интервал между отправками на облачные сервисы, секунд
+#define SENSORS_OPENMON_HOLDOFF                 60
+#define SENSORS_NARODMON_HOLDOFF                300
+#define SENSORS_THINGSPEAK_HOLDOFF              20
+
+// Контроль исправности источников температуры: допустимый диапазон, °С, максимальная скорость изменения, °С в минуту,
+// порог и время "залипания" (0 - не проверяется) и время, после которого показания считаются устаревшими, секунд.
+// Температура теплоносителя при выключенном котле может часами не меняться, поэтому "залипание" для нее не проверяется
+#define SENSORS_HEALTH_INDOOR_MIN               -20.0
+#define SENSORS_HEALTH_INDOOR_MAX               60.0
+#define SENSORS_HEALTH_INDOOR_RATE              2.0
+#define SENSORS_HEALTH_INDOOR_STUCK_DELTA       0.01
+#define SENSORS_HEALTH_INDOOR_STUCK_TIME        21600
+#define SENSORS_HEALTH_OUTDOOR_MIN              -50.0
+#define SENSORS_HEALTH_OUTDOOR_MAX              60.0
+#define SENSORS_HEALTH_OUTDOOR_RATE             2.0
+#define SENSORS_HEALTH_OUTDOOR_STUCK_DELTA      0.1
+#define SENSORS_HEALTH_OUTDOOR_STUCK_TIME       43200
+#define SENSORS_HEALTH_BOILER_MIN               0.0
+#define SENSORS_HEALTH_BOILER_MAX               110.0
+#define SENSORS_HEALTH_BOILER_RATE              10.0
+#define SENSORS_HEALTH_STALE_TIME               600
+
 // -----------------------------------------------------------------------------------------------------------------------
 // --------------------------------------------- Контроль температуры в доме ---------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -112,7 +181,11 @@ typedef enum {
   THERMOSTAT_ON,            // Котел включен всегда (без учета расписания и температуры)
   THERMOSTAT_TIME,          // Только управление по расписанию (без учета температуры)
   THERMOSTAT_TEMP,          // Только управление по температуре (без учета расписания)
-  THERMOSTAT_TIME_AND_TEMP  // Управление по расписанию и температуре одновременно
+  THERMOSTAT_TIME_AND_TEMP, // Управление по расписанию и температуре одновременно
+  THERMOSTAT_PREDICT,       // Управление по прогнозу тепловой модели дома (без учета расписания)
+  THERMOSTAT_TIME_AND_PREDICT, // Управление по расписанию и прогнозу тепловой модели дома
+  THERMOSTAT_PLAN,          // Управление по температуре с уставками недельного расписания (вне периодов - основная уставка)
+  THERMOSTAT_PLAN_PREDICT   // Управление по прогнозу тепловой модели с уставками недельного расписания
 } thermostat_mode_t;
 
 // Параметры регулирования температуры в доме
@@ -121,6 +194,14 @@ static float thermostatInternalHyst = 1.0;
 static timespan_t thermostatTimespan = 15000800U;
 static thermostat_mode_t thermostatMode = THERMOSTAT_TIME_AND_TEMP;
 static bool thermostatNotify = true;
+// Инерция системы отопления (время от включения котла до начала роста температуры в доме), секунд
+static uint32_t thermostatInertia = 900;
+// Защита котла от частых включений: минимальное время работы и простоя, секунд, и максимум запусков в час (0 - без ограничения)
+static uint32_t thermostatMinOn = 300;
+static uint32_t thermostatMinOff = 300;
+static uint8_t thermostatMaxStarts = 6;
+// При неисправности датчика в доме использовать оценку тепловой модели
+static bool thermostatFallback = true;
 
 #define CONTROL_THERMOSTAT_GROUP_KEY              "ths"
 #define CONTROL_THERMOSTAT_GROUP_TOPIC            "thermostat"
@@ -140,9 +221,30 @@ static bool thermostatNotify = true;
 #define CONTROL_THERMOSTAT_PARAM_MODE_FRIENDLY    "Режим работы"
 #define CONTROL_THERMOSTAT_PARAM_NOTIFY_KEY       "notifications"
 #define CONTROL_THERMOSTAT_PARAM_NOTIFY_FRIENDLY  "Уведомления"
+#define CONTROL_THERMOSTAT_PARAM_INERTIA_KEY      "inertia"
+#define CONTROL_THERMOSTAT_PARAM_INERTIA_FRIENDLY "Инерция отопления"
+#define CONTROL_THERMOSTAT_PARAM_MINON_KEY        "min_on"
+#define CONTROL_THERMOSTAT_PARAM_MINON_FRIENDLY   "Минимальное время работы"
+#define CONTROL_THERMOSTAT_PARAM_MINOFF_KEY       "min_off"
+#define CONTROL_THERMOSTAT_PARAM_MINOFF_FRIENDLY  "Минимальное время простоя"
+#define CONTROL_THERMOSTAT_PARAM_STARTS_KEY       "max_starts"
+#define CONTROL_THERMOSTAT_PARAM_STARTS_FRIENDLY  "Запусков в час"
+#define CONTROL_THERMOSTAT_STARTS_LIMIT           30
+#define CONTROL_THERMOSTAT_PARAM_FALLBACK_KEY     "fallback"
+#define CONTROL_THERMOSTAT_PARAM_FALLBACK_FRIENDLY "Резервный источник температуры"
+
+// Оценка температуры в доме по тепловой модели накапливает ошибку, поэтому используется не дольше заданного времени, секунд
+#define CONTROL_THERMOSTAT_FALLBACK_MAX           21600
+// Защита от замерзания, когда температура в доме неизвестна: котел включается при остывании теплоносителя
+// ниже CONTROL_THERMOSTAT_FROST_TEMP и выключается после нагрева на CONTROL_THERMOSTAT_FROST_HYST, °С
+#define CONTROL_THERMOSTAT_FROST_TEMP             10.0
+#define CONTROL_THERMOSTAT_FROST_HYST             20.0
 
 #define CONTROL_THERMOSTAT_BOILER_KEY             "boiler"
 #define CONTROL_THERMOSTAT_BOILER_TOPIC           "boiler"
+#define CONTROL_THERMOSTAT_GUARD_TOPIC            "boiler_guard"
+#define CONTROL_THERMOSTAT_STATS_TOPIC            "heating_stats"
+#define CONTROL_THERMOSTAT_HEALTH_TOPIC           "sensors_health"
 
 #define CONTROL_THERMOSTAT_NOTIFY_KIND            MK_MAIN
 #define CONTROL_THERMOSTAT_NOTIFY_PRIORITY        MP_ORDINARY
@@ -150,6 +252,42 @@ static bool thermostatNotify = true;
 #define CONTROL_THERMOSTAT_NOTIFY_ON              "🟠 Работа котла <b>разрешена</b>"
 #define CONTROL_THERMOSTAT_NOTIFY_OFF             "🟤 Работа котла <b>заблокирована</b>"
 
+#define CONTROL_THERMOSTAT_HEALTH_NOTIFY_PRIORITY MP_CRITICAL
+#define CONTROL_THERMOSTAT_NOTIFY_SENSOR_FAIL     "⚠️ Датчик <b>%s</b> <i>неисправен</i>: %s"
+#define CONTROL_THERMOSTAT_NOTIFY_SENSOR_OK       "🆗 Датчик <b>%s</b> <i>снова исправен</i>"
+#define CONTROL_THERMOSTAT_NOTIFY_SOURCE          "🔁 Температура для управления котлом: <b>%s</b>"
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- Последние показания ------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Источник температуры для управления котлом
+typedef enum {
+  SENSORS_SOURCE_INDOOR = 0,  // Датчик в доме
+  SENSORS_SOURCE_MODEL,       // Оценка тепловой модели по температурам на улице и теплоносителя
+  SENSORS_SOURCE_NONE         // Источников нет: котел управляется по температуре теплоносителя (защита от замерзания)
+} sensors_source_t;
+
+// Согласованный набор показаний: публикуется задачей сенсоров один раз за цикл, читается любой задачей без блокировок.
+// Если сенсор неисправен или его показания отбракованы модулем senshealth, его значения равны NAN
+typedef struct {
+  uint32_t cycle;           // Номер цикла опроса, в котором получены показания (0 - показаний еще нет)
+  time_t   time;            // Время опроса
+  float    outdoor_temp;    // Улица: температура, °С
+  float    outdoor_hum;     // Улица: влажность, %
+  float    indoor_temp;     // Комната: температура, °С
+  float    indoor_press;    // Комната: давление, мм рт. ст.
+  float    boiler_temp;     // Теплоноситель: температура, °С
+  bool     boiler_on;       // Состояние реле котла на момент публикации
+  float    control_temp;    // Температура в доме для управления котлом (с датчика или оценка резервного источника), °С
+  uint8_t  control_source;  // Источник control_temp, sensors_source_t
+} sensors_snapshot_t;
+
+/**
+ * Копирует последние показания в snapshot и возвращает номер цикла, в котором они были получены
+ * */
+uint32_t sensorsSnapshotGet(sensors_snapshot_t* snapshot);
+
 // -----------------------------------------------------------------------------------------------------------------------
 // ------------------------------------------------------- Задача --------------------------------------------------------
 // -----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,228 @@
+#include "thermomodel.h"
+#include <math.h>
+#include "esp_timer.h"
+#include "rLog.h"
+#include "rTypes.h"
+#include "reNvs.h"
+
+static const char* logTAG = "THMD";
+static const char* thermoModelNvsGroup = "thmodel";
+
+// Суммы для оценки коэффициентов методом наименьших квадратов с забыванием
+typedef struct {
+  float sxx;
+  float sxy;
+} thermo_lsq_t;
+
+// Текущий участок с неизменным состоянием котла
+typedef struct {
+  bool active;
+  bool boilerOn;
+  int64_t start;
+  float tempIndoor;
+  float sumOutdoor;
+  float sumFlow;
+  uint32_t cntOutdoor;
+  uint32_t cntFlow;
+} thermo_segment_t;
+
+static thermo_model_t _model = { 0.0, 0.0, 0, 0 };
+static thermo_lsq_t _lsqLoss = { 0.0, 0.0 };
+static thermo_lsq_t _lsqHeat = { 0.0, 0.0 };
+static thermo_segment_t _segment = { false, false, 0, NAN, 0.0, 0.0, 0, 0 };
+// Средняя температура теплоносителя при работающем котле - нужна для прогноза нагрева, пока котел выключен
+static float _flowOnAvg = NAN;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- NVS ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void thermoModelInit()
+{
+  nvsRead(thermoModelNvsGroup, "kloss", OPT_TYPE_FLOAT, &_model.kLoss);
+  nvsRead(thermoModelNvsGroup, "kheat", OPT_TYPE_FLOAT, &_model.kHeat);
+  nvsRead(thermoModelNvsGroup, "n_off", OPT_TYPE_U32, &_model.samplesOff);
+  nvsRead(thermoModelNvsGroup, "n_on", OPT_TYPE_U32, &_model.samplesOn);
+  nvsRead(thermoModelNvsGroup, "loss_xx", OPT_TYPE_FLOAT, &_lsqLoss.sxx);
+  nvsRead(thermoModelNvsGroup, "loss_xy", OPT_TYPE_FLOAT, &_lsqLoss.sxy);
+  nvsRead(thermoModelNvsGroup, "heat_xx", OPT_TYPE_FLOAT, &_lsqHeat.sxx);
+  nvsRead(thermoModelNvsGroup, "heat_xy", OPT_TYPE_FLOAT, &_lsqHeat.sxy);
+  nvsRead(thermoModelNvsGroup, "flow_on", OPT_TYPE_FLOAT, &_flowOnAvg);
+  rlog_i(logTAG, "Thermal model restored: kLoss=%.4f 1/h (%d), kHeat=%.4f 1/h (%d)",
+    _model.kLoss, _model.samplesOff, _model.kHeat, _model.samplesOn);
+}
+
+void thermoModelStore()
+{
+  nvsWrite(thermoModelNvsGroup, "kloss", OPT_TYPE_FLOAT, &_model.kLoss);
+  nvsWrite(thermoModelNvsGroup, "kheat", OPT_TYPE_FLOAT, &_model.kHeat);
+  nvsWrite(thermoModelNvsGroup, "n_off", OPT_TYPE_U32, &_model.samplesOff);
+  nvsWrite(thermoModelNvsGroup, "n_on", OPT_TYPE_U32, &_model.samplesOn);
+  nvsWrite(thermoModelNvsGroup, "loss_xx", OPT_TYPE_FLOAT, &_lsqLoss.sxx);
+  nvsWrite(thermoModelNvsGroup, "loss_xy", OPT_TYPE_FLOAT, &_lsqLoss.sxy);
+  nvsWrite(thermoModelNvsGroup, "heat_xx", OPT_TYPE_FLOAT, &_lsqHeat.sxx);
+  nvsWrite(thermoModelNvsGroup, "heat_xy", OPT_TYPE_FLOAT, &_lsqHeat.sxy);
+  if (!isnan(_flowOnAvg)) {
+    nvsWrite(thermoModelNvsGroup, "flow_on", OPT_TYPE_FLOAT, &_flowOnAvg);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Обучение ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void thermoModelSegmentStart(bool boilerOn, float tempIndoor)
+{
+  _segment.active = true;
+  _segment.boilerOn = boilerOn;
+  _segment.start = esp_timer_get_time();
+  _segment.tempIndoor = tempIndoor;
+  _segment.sumOutdoor = 0.0;
+  _segment.sumFlow = 0.0;
+  _segment.cntOutdoor = 0;
+  _segment.cntFlow = 0;
+}
+
+// weight - вес участка (доля от полной длительности CONFIG_THERMOMODEL_SAMPLE_INTERVAL)
+static float thermoModelLsqUpdate(thermo_lsq_t* lsq, float x, float y, float weight)
+{
+  lsq->sxx = CONFIG_THERMOMODEL_FORGETTING * lsq->sxx + weight * x * x;
+  lsq->sxy = CONFIG_THERMOMODEL_FORGETTING * lsq->sxy + weight * x * y;
+  return lsq->sxx > 0.0 ? lsq->sxy / lsq->sxx : 0.0;
+}
+
+static void thermoModelSegmentApply(float tempIndoor)
+{
+  int64_t duration = esp_timer_get_time() - _segment.start;
+  if ((_segment.cntOutdoor == 0) || (duration < (int64_t)CONFIG_THERMOMODEL_SEGMENT_MIN * 1000000)) return;
+  float hours = (float)duration / 3600000000.0;
+  float weight = (float)duration / ((float)CONFIG_THERMOMODEL_SAMPLE_INTERVAL * 1000000.0);
+  if (weight > 1.0) weight = 1.0;
+  float rate = (tempIndoor - _segment.tempIndoor) / hours;
+  float meanIndoor = 0.5 * (tempIndoor + _segment.tempIndoor);
+  float deltaOutdoor = meanIndoor - _segment.sumOutdoor / _segment.cntOutdoor;
+
+  if (!_segment.boilerOn) {
+    // Котел выключен: dTin/dt = -kLoss * (Tin - Tout)
+    if (deltaOutdoor > 1.0) {
+      float k = thermoModelLsqUpdate(&_lsqLoss, deltaOutdoor, -rate, weight);
+      _model.kLoss = k > 0.0 ? k : 0.0;
+      _model.samplesOff++;
+      rlog_d(logTAG, "Cooling segment: rate=%.3f °C/h, dTout=%.2f °C, kLoss=%.4f 1/h", rate, deltaOutdoor, _model.kLoss);
+    };
+  } else {
+    // Котел включен: dTin/dt + kLoss * (Tin - Tout) = kHeat * (Tflow - Tin)
+    if ((_segment.cntFlow > 0) && (_model.samplesOff > 0)) {
+      float meanFlow = _segment.sumFlow / _segment.cntFlow;
+      float deltaFlow = meanFlow - meanIndoor;
+      if (deltaFlow > 1.0) {
+        float k = thermoModelLsqUpdate(&_lsqHeat, deltaFlow, rate + _model.kLoss * deltaOutdoor, weight);
+        _model.kHeat = k > 0.0 ? k : 0.0;
+        _model.samplesOn++;
+        _flowOnAvg = isnan(_flowOnAvg) ? meanFlow : 0.8 * _flowOnAvg + 0.2 * meanFlow;
+        rlog_d(logTAG, "Heating segment: rate=%.3f °C/h, dTflow=%.2f °C, kHeat=%.4f 1/h", rate, deltaFlow, _model.kHeat);
+      };
+    };
+  };
+}
+
+void thermoModelUpdate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow)
+{
+  if (isnan(tempIndoor)) {
+    _segment.active = false;
+    return;
+  };
+
+  // При изменении состояния котла незавершенный участок учитывается с меньшим весом (если он не слишком короткий)
+  if (!_segment.active) {
+    thermoModelSegmentStart(boilerOn, tempIndoor);
+  } else if (_segment.boilerOn != boilerOn) {
+    thermoModelSegmentApply(tempIndoor);
+    thermoModelSegmentStart(boilerOn, tempIndoor);
+  };
+
+  if (!isnan(tempOutdoor)) {
+    _segment.sumOutdoor += tempOutdoor;
+    _segment.cntOutdoor++;
+  };
+  if (!isnan(tempFlow)) {
+    _segment.sumFlow += tempFlow;
+    _segment.cntFlow++;
+  };
+
+  if ((esp_timer_get_time() - _segment.start) >= (int64_t)CONFIG_THERMOMODEL_SAMPLE_INTERVAL * 1000000) {
+    thermoModelSegmentApply(tempIndoor);
+    thermoModelSegmentStart(boilerOn, tempIndoor);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Прогноз -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+bool thermoModelReady()
+{
+  return (_model.samplesOff >= CONFIG_THERMOMODEL_MIN_SAMPLES)
+      && (_model.samplesOn >= CONFIG_THERMOMODEL_MIN_SAMPLES)
+      && (_model.kLoss > 0.0) && (_model.kHeat > 0.0);
+}
+
+float thermoModelRate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow)
+{
+  float rate = isnan(tempOutdoor) ? 0.0 : -_model.kLoss * (tempIndoor - tempOutdoor);
+  if (boilerOn) {
+    // Если котел еще не прогрет (или выключен), используем типичную температуру теплоносителя
+    float flow = tempFlow;
+    if (!isnan(_flowOnAvg) && (isnan(flow) || (flow < _flowOnAvg))) {
+      flow = _flowOnAvg;
+    };
+    if (!isnan(flow) && (flow > tempIndoor)) {
+      rate += _model.kHeat * (flow - tempIndoor);
+    };
+  };
+  return rate;
+}
+
+int32_t thermoModelTimeTo(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow, float tempTarget)
+{
+  float rate = thermoModelRate(boilerOn, tempIndoor, tempOutdoor, tempFlow);
+  float delta = tempTarget - tempIndoor;
+  if (delta == 0.0) return 0;
+  if ((rate == 0.0) || ((delta > 0.0) != (rate > 0.0))) return -1;
+  return (int32_t)(3600.0 * delta / rate);
+}
+
+bool thermoModelDecide(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow,
+  float tempLow, float tempHigh, uint32_t lagSec)
+{
+  // Пока модель не обучена - обычный гистерезис
+  if (!thermoModelReady()) {
+    return boilerOn ? tempIndoor < tempHigh : tempIndoor < tempLow;
+  };
+
+  float lagHours = (float)lagSec / 3600.0;
+  if (boilerOn) {
+    // Котел включен: после выключения температура продолжит расти еще lagSec за счет остывающего теплоносителя
+    float predicted = tempIndoor + thermoModelRate(true, tempIndoor, tempOutdoor, tempFlow) * lagHours;
+    bool ret = predicted < tempHigh;
+    if (!ret) {
+      rlog_i(logTAG, "Predicted %.2f °C in %d s, boiler can be stopped; next start in ~%d s",
+        predicted, lagSec, thermoModelTimeTo(false, predicted, tempOutdoor, NAN, tempLow));
+    };
+    return ret;
+  } else {
+    // Котел выключен: после включения дом начнет прогреваться только через lagSec
+    float predicted = tempIndoor + thermoModelRate(false, tempIndoor, tempOutdoor, NAN) * lagHours;
+    bool ret = predicted < tempLow;
+    if (ret) {
+      rlog_i(logTAG, "Predicted %.2f °C in %d s, boiler must be started; expected run time ~%d s",
+        predicted, lagSec, thermoModelTimeTo(true, predicted, tempOutdoor, tempFlow, tempHigh));
+    };
+    return ret;
+  };
+}
+
+void thermoModelGet(thermo_model_t* model)
+{
+  if (model) *model = _model;
+}
@@ -0,0 +1,96 @@
+/*
+   Модуль простой тепловой модели дома для прогнозирующего термостата.
+   Модель первого порядка: dTin/dt = kHeat * (Tflow - Tin) * boiler - kLoss * (Tin - Tout),
+   коэффициенты kLoss (теплопотери, 1/ч) и kHeat (нагрев от теплоносителя, 1/ч) уточняются "на лету"
+   методом наименьших квадратов с забыванием по участкам с неизменным состоянием котла.
+   Участок закрывается по истечении CONFIG_THERMOMODEL_SAMPLE_INTERVAL или при переключении котла; короткие участки
+   (но не короче CONFIG_THERMOMODEL_SEGMENT_MIN) учитываются с весом, пропорциональным их длительности
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __THERMOMODEL_H__
+#define __THERMOMODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "project_config.h"
+
+// Полная длительность участка для оценки скорости изменения температуры, секунд
+#ifndef CONFIG_THERMOMODEL_SAMPLE_INTERVAL
+#define CONFIG_THERMOMODEL_SAMPLE_INTERVAL 600
+#endif // CONFIG_THERMOMODEL_SAMPLE_INTERVAL
+
+// Минимальная длительность участка, прерванного переключением котла, при которой он еще учитывается, секунд
+#ifndef CONFIG_THERMOMODEL_SEGMENT_MIN
+#define CONFIG_THERMOMODEL_SEGMENT_MIN 180
+#endif // CONFIG_THERMOMODEL_SEGMENT_MIN
+
+// Коэффициент забывания старых участков (0..1, чем ближе к 1, тем "длиннее память")
+#ifndef CONFIG_THERMOMODEL_FORGETTING
+#define CONFIG_THERMOMODEL_FORGETTING 0.98
+#endif // CONFIG_THERMOMODEL_FORGETTING
+
+// Минимальное количество участков для каждого из режимов, после которого модель считается обученной
+#ifndef CONFIG_THERMOMODEL_MIN_SAMPLES
+#define CONFIG_THERMOMODEL_MIN_SAMPLES 6
+#endif // CONFIG_THERMOMODEL_MIN_SAMPLES
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  float kLoss;              // Коэффициент теплопотерь, 1/ч
+  float kHeat;              // Коэффициент нагрева от теплоносителя, 1/ч
+  uint32_t samplesOff;      // Количество учтенных участков с выключенным котлом
+  uint32_t samplesOn;       // Количество учтенных участков с включенным котлом
+} thermo_model_t;
+
+/**
+ * Восстановление коэффициентов модели из NVS и сохранение их в NVS
+ * */
+void thermoModelInit();
+void thermoModelStore();
+
+/**
+ * Передача в модель очередного измерения. tempFlow может быть NAN, если котел выключен или датчик неисправен
+ * */
+void thermoModelUpdate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow);
+
+/**
+ * Модель обучена и может использоваться для прогноза
+ * */
+bool thermoModelReady();
+
+/**
+ * Прогнозируемая скорость изменения температуры в доме, °С/ч
+ * */
+float thermoModelRate(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow);
+
+/**
+ * Прогнозируемое время (в секундах), через которое температура в доме достигнет tempTarget при неизменном состоянии котла,
+ * -1 если при текущих условиях этого не произойдет
+ * */
+int32_t thermoModelTimeTo(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow, float tempTarget);
+
+/**
+ * Решение прогнозирующего термостата: котел выключается, если с учетом инерции системы (lagSec) температура
+ * превысит верхнюю границу, и включается, если за то же время она опустится ниже нижней границы.
+ * Решение принимается по прогнозу на конец интервала инерции, а не по текущей температуре
+ * */
+bool thermoModelDecide(bool boilerOn, float tempIndoor, float tempOutdoor, float tempFlow,
+  float tempLow, float tempHigh, uint32_t lagSec);
+
+/**
+ * Текущие коэффициенты модели
+ * */
+void thermoModelGet(thermo_model_t* model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __THERMOMODEL_H__
@@ -0,0 +1,271 @@
+#include "timesched.h"
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "rLog.h"
+#include "reEsp32.h"
+#include "reEvents.h"
+
+static const char* logTAG = "TSCH";
+
+#define TIMESCHED_TIME_VALID    1000000000
+
+typedef struct {
+  timespan_t* timespan;                               // Интервал ЧЧММЧЧММ
+  int8_t state;                                       // -1 - еще не вычислено
+  time_t next;                                        // Ближайшее переключение, 0 - нет
+} timesched_item_t;
+
+static timesched_item_t _items[CONFIG_TIMESCHED_ITEMS];
+static uint8_t _itemsCount = 0;
+static uint8_t _heap[CONFIG_TIMESCHED_ITEMS];
+static uint8_t _heapCount = 0;
+static bool _schedRebuild = true;
+static bool _handlersRegistered = false;
+static esp_timer_handle_t _schedTimer = nullptr;
+static SemaphoreHandle_t _schedLock = nullptr;
+static StaticSemaphore_t _schedLockBuffer;
+
+static void timeSchedTimeout(void* arg);
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Вычисления -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Ближайший момент после now, в который состояние расписания станет отличным от state (0 - таких нет)
+static time_t timeSchedFindNext(timesched_item_t* item, time_t now, bool state)
+{
+  // Возможные моменты переключения внутри суток (ЧЧММ): начало и окончание интервала
+  if (*item->timespan == 0) return 0;
+  uint16_t points[2] = { (uint16_t)(*item->timespan / 10000), (uint16_t)(*item->timespan % 10000) };
+  if (points[0] > points[1]) {
+    // Интервал через полночь: внутри суток окончание наступает раньше начала
+    points[0] = points[1];
+    points[1] = (uint16_t)(*item->timespan / 10000);
+  };
+
+  struct tm today;
+  localtime_r(&now, &today);
+  // Интервал повторяется каждые сутки, поэтому достаточно просмотреть двое суток
+  for (uint8_t day = 0; day <= 1; day++) {
+    for (uint8_t i = 0; i < 2; i++) {
+      struct tm ti;
+      memset(&ti, 0, sizeof(ti));
+      ti.tm_year = today.tm_year;
+      ti.tm_mon = today.tm_mon;
+      ti.tm_mday = today.tm_mday + day;
+      ti.tm_hour = points[i] / 100;
+      ti.tm_min = points[i] % 100;
+      ti.tm_isdst = -1;
+      time_t moment = mktime(&ti);
+      if ((moment > now) && (checkTimespan(&ti, *item->timespan) != state)) {
+        return moment;
+      };
+    };
+  };
+  return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- Очередь -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static inline bool timeSchedLess(uint8_t a, uint8_t b)
+{
+  return _items[_heap[a]].next < _items[_heap[b]].next;
+}
+
+static inline void timeSchedSwap(uint8_t a, uint8_t b)
+{
+  uint8_t tmp = _heap[a];
+  _heap[a] = _heap[b];
+  _heap[b] = tmp;
+}
+
+static void timeSchedSiftUp(uint8_t pos)
+{
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (!timeSchedLess(pos, parent)) break;
+    timeSchedSwap(pos, parent);
+    pos = parent;
+  };
+}
+
+static void timeSchedSiftDown(uint8_t pos)
+{
+  while (1) {
+    uint8_t left = 2 * pos + 1;
+    uint8_t right = left + 1;
+    uint8_t least = pos;
+    if ((left < _heapCount) && timeSchedLess(left, least)) least = left;
+    if ((right < _heapCount) && timeSchedLess(right, least)) least = right;
+    if (least == pos) break;
+    timeSchedSwap(pos, least);
+    pos = least;
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Таймер -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Пересчет состояния и следующего переключения одного расписания (состояние - один байт, читается без блокировки)
+static void timeSchedUpdate(uint8_t index, time_t now)
+{
+  timesched_item_t* item = &_items[index];
+  struct tm ti;
+  localtime_r(&now, &ti);
+  bool state = checkTimespan(&ti, *item->timespan);
+  item->next = timeSchedFindNext(item, now, state);
+  item->state = state ? 1 : 0;
+  rlog_d(logTAG, "Schedule %d: state %d, next transition in %d s", index, state, item->next ? (int)(item->next - now) : -1);
+}
+
+static void timeSchedRebuild(time_t now)
+{
+  _heapCount = 0;
+  for (uint8_t i = 0; i < _itemsCount; i++) {
+    timeSchedUpdate(i, now);
+    if (_items[i].next > 0) {
+      _heap[_heapCount] = i;
+      timeSchedSiftUp(_heapCount++);
+    };
+  };
+}
+
+static void timeSchedArm()
+{
+  esp_timer_stop(_schedTimer);
+  int64_t timeout_us = 1000;
+  if (!_schedRebuild) {
+    if (_heapCount == 0) return;
+    // Срабатываем через 1 мс после начала секунды переключения
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    int64_t wait = _items[_heap[0]].next - now.tv_sec;
+    if (wait > CONFIG_TIMESCHED_MAX_WAIT) wait = CONFIG_TIMESCHED_MAX_WAIT;
+    timeout_us = wait * 1000000 - now.tv_usec + 1000;
+    if (timeout_us < 1000) timeout_us = 1000;
+  };
+  RE_OK_CHECK(esp_timer_start_once(_schedTimer, (uint64_t)timeout_us), return);
+}
+
+static void timeSchedTimeout(void* arg)
+{
+  xSemaphoreTakeRecursive(_schedLock, portMAX_DELAY);
+  time_t now = time(nullptr);
+  // Пока время не синхронизировано, ждем события от SNTP или RTC
+  if (now > TIMESCHED_TIME_VALID) {
+    if (_schedRebuild) {
+      _schedRebuild = false;
+      timeSchedRebuild(now);
+    } else {
+      while ((_heapCount > 0) && (_items[_heap[0]].next <= now)) {
+        uint8_t index = _heap[0];
+        timeSchedUpdate(index, now);
+        if (_items[index].next == 0) {
+          _heap[0] = _heap[--_heapCount];
+        };
+        timeSchedSiftDown(0);
+      };
+    };
+    timeSchedArm();
+  };
+  xSemaphoreGiveRecursive(_schedLock);
+}
+
+static bool timeSchedInit()
+{
+  if (!_schedLock) {
+    _schedLock = xSemaphoreCreateRecursiveMutexStatic(&_schedLockBuffer);
+    if (!_schedLock) return false;
+  };
+  if (!_schedTimer) {
+    esp_timer_create_args_t tmr_cfg;
+    memset(&tmr_cfg, 0, sizeof(tmr_cfg));
+    tmr_cfg.callback = timeSchedTimeout;
+    tmr_cfg.dispatch_method = ESP_TIMER_TASK;
+    tmr_cfg.name = "timesched";
+    tmr_cfg.skip_unhandled_events = true;
+    RE_OK_CHECK(esp_timer_create(&tmr_cfg, &_schedTimer), return false);
+  };
+  return true;
+}
+
+// Полный пересчет всех расписаний в задаче таймера
+static void timeSchedKick()
+{
+  if (!timeSchedInit()) return;
+  xSemaphoreTakeRecursive(_schedLock, portMAX_DELAY);
+  _schedRebuild = true;
+  timeSchedArm();
+  xSemaphoreGiveRecursive(_schedLock);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Публичные ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+timesched_t timeSchedRegisterTimespan(timespan_t* timespan)
+{
+  if (!timespan || !timeSchedInit()) return TIMESCHED_NONE;
+
+  timesched_t ret = TIMESCHED_NONE;
+  xSemaphoreTakeRecursive(_schedLock, portMAX_DELAY);
+  if (_itemsCount < CONFIG_TIMESCHED_ITEMS) {
+    timesched_item_t* item = &_items[_itemsCount];
+    memset(item, 0, sizeof(timesched_item_t));
+    item->timespan = timespan;
+    item->state = -1;
+    ret = _itemsCount++;
+  };
+  xSemaphoreGiveRecursive(_schedLock);
+
+  if (ret == TIMESCHED_NONE) {
+    rlog_e(logTAG, "Failed to register schedule: too many schedules");
+  } else {
+    timeSchedKick();
+  };
+  return ret;
+}
+
+bool timeSchedGetState(timesched_t item)
+{
+  return (item >= 0) && (item < _itemsCount) && (_items[item].state == 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Обработчики событий ----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void timeSchedTimeEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  // Часы установлены или скорректированы - все моменты переключения нужно вычислить заново
+  timeSchedKick();
+}
+
+static void timeSchedParamsEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if ((event_id == RE_PARAMS_CHANGED) && (event_data)) {
+    for (uint8_t i = 0; i < _itemsCount; i++) {
+      if (*(uint32_t*)event_data == (uint32_t)_items[i].timespan) {
+        timeSchedKick();
+        break;
+      };
+    };
+  };
+}
+
+bool timeSchedEventHandlerRegister()
+{
+  if (!_handlersRegistered) {
+    _handlersRegistered = timeSchedInit()
+      && eventHandlerRegister(RE_TIME_EVENTS, RE_TIME_RTC_ENABLED, &timeSchedTimeEventHandler, nullptr)
+      && eventHandlerRegister(RE_TIME_EVENTS, RE_TIME_SNTP_SYNC_OK, &timeSchedTimeEventHandler, nullptr)
+      && eventHandlerRegister(RE_PARAMS_EVENTS, RE_PARAMS_CHANGED, &timeSchedParamsEventHandler, nullptr);
+  };
+  return _handlersRegistered;
+}
@@ -0,0 +1,63 @@
+/*
+   Модуль расписаний с заранее вычисленными моментами переключения.
+   Для каждого расписания один раз вычисляется текущее состояние и ближайший момент, когда оно изменится.
+   Моменты хранятся в двоичной куче (min-heap), а единственный таймер esp_timer взводится на самый ранний из них,
+   поэтому переключение происходит с точностью до секунды, а между переключениями модуль не просыпается
+   (не реже одного раза в CONFIG_TIMESCHED_MAX_WAIT секунд таймер сверяется с системными часами).
+
+   Расписание - обычный интервал timespan_t (ЧЧММЧЧММ, как в reScheduler), текущее состояние которого
+   читается без вычислений через timeSchedGetState().
+   Полный пересчет выполняется после синхронизации часов и при изменении параметра timespan_t через reParams
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __TIMESCHED_H__
+#define __TIMESCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "rTypes.h"
+#include "project_config.h"
+
+// Максимальное количество расписаний
+#ifndef CONFIG_TIMESCHED_ITEMS
+#define CONFIG_TIMESCHED_ITEMS 8
+#endif // CONFIG_TIMESCHED_ITEMS
+
+// Максимальное время ожидания таймера, секунд
+#ifndef CONFIG_TIMESCHED_MAX_WAIT
+#define CONFIG_TIMESCHED_MAX_WAIT 3600
+#endif // CONFIG_TIMESCHED_MAX_WAIT
+
+#define TIMESCHED_NONE        -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int8_t timesched_t;
+
+/**
+ * Регистрация интервала timespan_t. Значение читается по указателю при каждом пересчете,
+ * поэтому параметр, зарегистрированный в reParams, может изменяться "на лету"
+ * */
+timesched_t timeSchedRegisterTimespan(timespan_t* timespan);
+
+/**
+ * Текущее состояние расписания (false, если время еще не синхронизировано)
+ * */
+bool timeSchedGetState(timesched_t item);
+
+/**
+ * Регистрация обработчиков событий синхронизации времени и изменения параметров
+ * */
+bool timeSchedEventHandlerRegister();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TIMESCHED_H__
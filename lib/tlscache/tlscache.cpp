@@ -0,0 +1,277 @@
+#include "tlscache.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "rLog.h"
+#include "rStrings.h"
+#include "reEvents.h"
+#include "reMqtt.h"
+#include "def_consts.h"
+#include "perfstat.h"
+
+static const char* logTAG = "TLSC";
+
+#if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+typedef struct {
+  char host[CONFIG_TLSCACHE_HOST_MAX];
+  int port;
+  esp_tls_client_session_t* session;
+  uint8_t users;          // Количество подключений, использующих сессию в данный момент
+  uint32_t used;          // Порядковый номер последнего использования (для вытеснения)
+} tls_cache_entry_t;
+
+static tls_cache_entry_t _cache[CONFIG_TLSCACHE_SLOTS];
+static uint32_t _cacheUsed = 0;
+
+#endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+static tls_cache_stats_t _stats = {0, 0, 0, 0, 0, 0, 0};
+static uint64_t _hitTimeTotal = 0;
+static uint64_t _missTimeTotal = 0;
+static uint32_t _hitTimeCount = 0;
+static uint32_t _missTimeCount = 0;
+static portMUX_TYPE _cacheMux = portMUX_INITIALIZER_UNLOCKED;
+static perf_metric_t _perfConnect = PERF_METRIC_NONE;
+
+extern "C" int __real_esp_tls_conn_new_sync(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
+extern "C" int __real_esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Кэш ---------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+#if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+// Вызывается внутри критической секции
+static int tlsCacheFind(const char *hostname, int hostlen, int port)
+{
+  if ((hostlen <= 0) || (hostlen >= CONFIG_TLSCACHE_HOST_MAX)) return -1;
+  for (int i = 0; i < CONFIG_TLSCACHE_SLOTS; i++) {
+    if ((_cache[i].port == port) && (strncmp(_cache[i].host, hostname, hostlen) == 0) && (_cache[i].host[hostlen] == 0)) {
+      return i;
+    };
+  };
+  return -1;
+}
+
+// Вызывается внутри критической секции: свободный слот или самый давно использованный, не занятый подключением
+static int tlsCacheAlloc(const char *hostname, int hostlen, int port, esp_tls_client_session_t** evicted)
+{
+  if ((hostlen <= 0) || (hostlen >= CONFIG_TLSCACHE_HOST_MAX)) return -1;
+  int slot = -1;
+  for (int i = 0; i < CONFIG_TLSCACHE_SLOTS; i++) {
+    if (_cache[i].users == 0) {
+      if (_cache[i].host[0] == 0) {
+        slot = i;
+        break;
+      };
+      if ((slot < 0) || (_cache[i].used < _cache[slot].used)) {
+        slot = i;
+      };
+    };
+  };
+  if (slot >= 0) {
+    *evicted = _cache[slot].session;
+    memset(_cache[slot].host, 0, CONFIG_TLSCACHE_HOST_MAX);
+    memcpy(_cache[slot].host, hostname, hostlen);
+    _cache[slot].port = port;
+    _cache[slot].session = nullptr;
+  };
+  return slot;
+}
+
+// Выдача сохраненной сессии на время вызова esp_tls_conn_new_xxx()
+static esp_tls_client_session_t* tlsCacheAcquire(const char *hostname, int hostlen, int port, int* slot)
+{
+  esp_tls_client_session_t* session = nullptr;
+  portENTER_CRITICAL(&_cacheMux);
+  *slot = tlsCacheFind(hostname, hostlen, port);
+  if ((*slot >= 0) && (_cache[*slot].session)) {
+    session = _cache[*slot].session;
+    _cache[*slot].users++;
+    _cache[*slot].used = ++_cacheUsed;
+  };
+  portEXIT_CRITICAL(&_cacheMux);
+  return session;
+}
+
+static void tlsCacheRelease(const char *hostname, int hostlen, int port, int slot, esp_tls_client_session_t* session, esp_tls_t *tls, int ret)
+{
+  esp_tls_client_session_t* fresh = nullptr;
+  esp_tls_client_session_t* garbage = nullptr;
+  esp_tls_client_session_t* evicted = nullptr;
+
+  // Копию новой сессии получаем до входа в критическую секцию (выделяет память)
+  if (ret > 0) {
+    fresh = esp_tls_get_client_session(tls);
+  };
+
+  portENTER_CRITICAL(&_cacheMux);
+  if (session) {
+    _cache[slot].users--;
+  } else {
+    // Пока шло подключение, свободный слот мог быть отдан другому хосту
+    slot = tlsCacheFind(hostname, hostlen, port);
+  };
+  if (ret > 0) {
+    if (fresh) {
+      if (slot < 0) {
+        slot = tlsCacheAlloc(hostname, hostlen, port, &evicted);
+      };
+      // Сессию, которой сейчас пользуется другое подключение, не заменяем - обновим в следующий раз
+      if ((slot >= 0) && (_cache[slot].users == 0)) {
+        garbage = _cache[slot].session;
+        _cache[slot].session = fresh;
+        _cache[slot].used = ++_cacheUsed;
+        _stats.stored++;
+        fresh = nullptr;
+      };
+    };
+  } else if (ret < 0) {
+    // Предложенная сессия могла стать причиной отказа - больше ее не предлагаем
+    if (session && (_cache[slot].users == 0) && (_cache[slot].session == session)) {
+      garbage = _cache[slot].session;
+      _cache[slot].session = nullptr;
+    };
+  };
+  portEXIT_CRITICAL(&_cacheMux);
+
+  if (fresh) esp_tls_free_client_session(fresh);
+  if (garbage) esp_tls_free_client_session(garbage);
+  if (evicted) esp_tls_free_client_session(evicted);
+}
+
+#endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+static void tlsCacheAccount(bool hit, int ret, int64_t elapsed_us)
+{
+  portENTER_CRITICAL(&_cacheMux);
+  if (ret > 0) {
+    if (hit) {
+      _stats.hits++;
+      if (elapsed_us > 0) {
+        _hitTimeTotal += elapsed_us;
+        _hitTimeCount++;
+      };
+    } else {
+      _stats.misses++;
+      if (elapsed_us > 0) {
+        _missTimeTotal += elapsed_us;
+        _missTimeCount++;
+      };
+    };
+  } else if (ret < 0) {
+    _stats.failures++;
+  };
+  portEXIT_CRITICAL(&_cacheMux);
+
+  // Время установки TLS соединения - основная часть задержки отправки в Telegram и облачные сервисы
+  if ((ret > 0) && (elapsed_us > 0)) {
+    if (_perfConnect == PERF_METRIC_NONE) {
+      _perfConnect = perfRegister("tls_connect");
+    };
+    perfRecord(_perfConnect, (uint32_t)elapsed_us);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Подмена функций esp-tls ---------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+extern "C" int __wrap_esp_tls_conn_new_sync(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls)
+{
+  #if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Клиент, самостоятельно управляющий сессией, не трогаем
+    if ((cfg == nullptr) || (cfg->client_session != nullptr)) {
+      return __real_esp_tls_conn_new_sync(hostname, hostlen, port, cfg, tls);
+    };
+    int slot = -1;
+    esp_tls_cfg_t cfg_session = *cfg;
+    cfg_session.client_session = tlsCacheAcquire(hostname, hostlen, port, &slot);
+    int64_t start = esp_timer_get_time();
+    int ret = __real_esp_tls_conn_new_sync(hostname, hostlen, port, &cfg_session, tls);
+    tlsCacheAccount(cfg_session.client_session != nullptr, ret, esp_timer_get_time() - start);
+    tlsCacheRelease(hostname, hostlen, port, slot, cfg_session.client_session, tls, ret);
+    if ((ret > 0) && (cfg_session.client_session)) {
+      rlog_d(logTAG, "Connected to %.*s:%d using cached TLS session", hostlen, hostname, port);
+    };
+    return ret;
+  #else
+    return __real_esp_tls_conn_new_sync(hostname, hostlen, port, cfg, tls);
+  #endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+}
+
+// Асинхронное подключение вызывается многократно до завершения (0 - в процессе), время не учитывается
+extern "C" int __wrap_esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls)
+{
+  #if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if ((cfg == nullptr) || (cfg->client_session != nullptr)) {
+      return __real_esp_tls_conn_new_async(hostname, hostlen, port, cfg, tls);
+    };
+    int slot = -1;
+    esp_tls_cfg_t cfg_session = *cfg;
+    cfg_session.client_session = tlsCacheAcquire(hostname, hostlen, port, &slot);
+    int ret = __real_esp_tls_conn_new_async(hostname, hostlen, port, &cfg_session, tls);
+    tlsCacheAccount(cfg_session.client_session != nullptr, ret, 0);
+    tlsCacheRelease(hostname, hostlen, port, slot, cfg_session.client_session, tls, ret);
+    return ret;
+  #else
+    return __real_esp_tls_conn_new_async(hostname, hostlen, port, cfg, tls);
+  #endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Публичные ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+void tlsCacheGetStats(tls_cache_stats_t* stats)
+{
+  portENTER_CRITICAL(&_cacheMux);
+  *stats = _stats;
+  stats->hit_time_ms = _hitTimeCount > 0 ? (uint32_t)(_hitTimeTotal / _hitTimeCount / 1000) : 0;
+  stats->miss_time_ms = _missTimeCount > 0 ? (uint32_t)(_missTimeTotal / _missTimeCount / 1000) : 0;
+  stats->entries = 0;
+  #if defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    for (int i = 0; i < CONFIG_TLSCACHE_SLOTS; i++) {
+      if (_cache[i].session) stats->entries++;
+    };
+  #endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+  portEXIT_CRITICAL(&_cacheMux);
+}
+
+char* tlsCacheGetJson()
+{
+  tls_cache_stats_t stats;
+  tlsCacheGetStats(&stats);
+  return malloc_stringf("{\"hits\":%" PRIu32 ",\"misses\":%" PRIu32 ",\"failures\":%" PRIu32 ",\"stored\":%" PRIu32 
+    ",\"entries\":%u,\"hit_time_ms\":%" PRIu32 ",\"miss_time_ms\":%" PRIu32 "}",
+    stats.hits, stats.misses, stats.failures, stats.stored, (unsigned)stats.entries, stats.hit_time_ms, stats.miss_time_ms);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------- Публикация статистики -----------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Статистика публикуется после каждого подключения к брокеру: к этому моменту в нее уже попало и само подключение MQTT
+static void tlsCacheMqttEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+  if (event_id == RE_MQTT_CONNECTED) {
+    re_mqtt_event_data_t* data = (re_mqtt_event_data_t*)event_data;
+    char* topic = mqttGetTopicDevice2(data->primary, CONFIG_MQTT_SYSINFO_LOCAL, CONFIG_MQTT_SYSINFO_TOPIC, "tls");
+    char* json = tlsCacheGetJson();
+    if (topic && json) {
+      mqttPublish(topic, json, CONFIG_MQTT_SYSINFO_QOS, CONFIG_MQTT_SYSINFO_RETAINED, true, true);
+    } else {
+      if (topic) free(topic);
+      if (json) free(json);
+    };
+  };
+}
+
+bool tlsCacheEventHandlerRegister()
+{
+  return eventHandlerRegister(RE_MQTT_EVENTS, RE_MQTT_CONNECTED, &tlsCacheMqttEventHandler, nullptr);
+}
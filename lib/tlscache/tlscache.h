@@ -0,0 +1,66 @@
+/*
+   Модуль общего кэша TLS-сессий.
+   Все HTTPS и MQTTS клиенты устройства (MQTT, Telegram, отправка данных, OTA) устанавливают соединения через 
+   esp_transport_ssl, который вызывает esp_tls_conn_new_sync() / esp_tls_conn_new_async(). Эти функции подменяются 
+   через ключи компоновщика -Wl,--wrap=..., и при повторном подключении к тому же хосту клиенту предлагается сохраненная 
+   сессия (session ticket / session ID). Сервер, принявший сессию, пропускает ECDHE и проверку цепочки сертификатов.
+   Статистика кэша публикуется после каждого подключения к брокеру MQTT (топик sysinfo/tls).
+   Сессии не сбрасываются при потере сети: возобновление сессии после переподключения - основной выигрыш кэша,
+   а сессию, отвергнутую сервером, модуль удаляет сам.
+   Требуется CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS=y в sdkconfig, иначе модуль прозрачно пропускает вызовы
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __TLSCACHE_H__
+#define __TLSCACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "project_config.h"
+
+// Количество хостов, для которых хранятся сессии
+#ifndef CONFIG_TLSCACHE_SLOTS
+#define CONFIG_TLSCACHE_SLOTS 8
+#endif // CONFIG_TLSCACHE_SLOTS
+
+// Максимальная длина имени хоста
+#ifndef CONFIG_TLSCACHE_HOST_MAX
+#define CONFIG_TLSCACHE_HOST_MAX 64
+#endif // CONFIG_TLSCACHE_HOST_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint32_t hits;          // Подключения, при которых была предложена сохраненная сессия
+  uint32_t misses;        // Подключения с полным рукопожатием (сессии в кэше не было)
+  uint32_t failures;      // Неудачные подключения
+  uint32_t stored;        // Сохранено (обновлено) сессий
+  uint32_t hit_time_ms;   // Среднее время подключения с сохраненной сессией, мс
+  uint32_t miss_time_ms;  // Среднее время подключения с полным рукопожатием, мс
+  uint8_t  entries;       // Количество хостов в кэше
+} tls_cache_stats_t;
+
+/**
+ * Получить статистику кэша
+ * */
+void tlsCacheGetStats(tls_cache_stats_t* stats);
+
+/**
+ * Статистика кэша в формате JSON (строка должна быть освобождена вызывающим)
+ * */
+char* tlsCacheGetJson();
+
+/**
+ * Регистрация обработчика событий MQTT для публикации статистики
+ * */
+bool tlsCacheEventHandlerRegister();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TLSCACHE_H__
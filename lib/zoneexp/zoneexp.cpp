@@ -0,0 +1,400 @@
+#include "zoneexp.h"
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "rLog.h"
+#include "rTypes.h"
+#include "reEsp32.h"
+#include "def_tasks.h"
+#include "reMCP23017.h"
+#include "i2cbatch.h"
+#include "perfstat.h"
+
+static const char* logTAG = "ZEXP";
+static const char* zoneExpTaskName = "zone_exp";
+
+// Регистры MCP23017 в режиме BANK = 0 (устанавливается reMCP23017::configSet)
+#define ZONEEXP_REG_INTFA     0x0E   // INTFA, INTFB, INTCAPA, INTCAPB, GPIOA, GPIOB - подряд
+#define ZONEEXP_REG_GPIOA     0x12
+#define ZONEEXP_BURST_SIZE    6
+
+// Количество проходов подряд для одного прерывания, после которого задача делает паузу
+#define ZONEEXP_MAX_PASSES    16
+// Пауза перед повтором, мс: после ZONEEXP_MAX_PASSES проходов и после ошибки обмена (удваивается с каждой ошибкой подряд)
+#define ZONEEXP_RETRY_DELAY   100
+#define ZONEEXP_RETRY_MAX     30000
+
+// Результат одного прохода по микросхеме
+typedef enum {
+  ZONEEXP_IDLE = 0,             // Микросхема не запрашивала прерывание, изменений нет
+  ZONEEXP_SERVICED,             // Прерывание обработано
+  ZONEEXP_AGAIN,                // Требуется повторный проход (дребезг или очередь переполнена)
+  ZONEEXP_FAILED                // Ошибка обмена, микросхема отключена до retry_time
+} zone_exp_result_t;
+
+typedef struct {
+  reMCP23017* device;
+  i2c_port_t i2c_num;
+  uint8_t i2c_address;
+  uint8_t int_gpio;
+  uint16_t active_low;
+  uint16_t pullups;
+  TickType_t debounce;
+  uint16_t state;               // Подтвержденные уровни входов (1 - зона активна)
+  uint32_t errors;
+  uint32_t bounces;
+  uint8_t fails;                // Ошибок обмена подряд (больше 0 - микросхема неисправна)
+  int64_t retry_time;           // Время следующей попытки для отложенной микросхемы, мкс
+  volatile uint32_t int_time;   // Время последнего прерывания, мкс
+} zone_exp_t;
+
+static zone_exp_t _chips[CONFIG_ZONEEXP_MAX_CHIPS];
+static uint8_t _chipsCount = 0;
+static QueueHandle_t _zoneExpQueue = nullptr;
+static TaskHandle_t _zoneExpTask = nullptr;
+static StaticTask_t _zoneExpTaskBuffer;
+static StackType_t _zoneExpTaskStack[CONFIG_ZONEEXP_TASK_STACK_SIZE];
+static perf_metric_t _perfLatency = PERF_METRIC_NONE;
+static perf_metric_t _perfAlarm = PERF_METRIC_NONE;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Прерывание -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// В аргументе передается маска микросхем, подключенных к этому выводу
+static void IRAM_ATTR zoneExpIsrHandler(void* arg)
+{
+  uint32_t chips = (uint32_t)arg;
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  for (uint8_t i = 0; i < _chipsCount; i++) {
+    if (chips & (1UL << i)) _chips[i].int_time = now;
+  };
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(_zoneExpTask, chips, eSetBits, &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Входы -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static bool zoneExpRead(zone_exp_t* chip, uint8_t reg, uint8_t* data, size_t size)
+{
+  i2c_batch_t batch;
+  i2cBatchInit(&batch, chip->i2c_num, CONFIG_ZONEEXP_I2C_TIMEOUT);
+  i2cBatchAddRead(&batch, chip->i2c_address, &reg, 1, data, size, 0);
+  if (i2cBatchExec(&batch) != ESP_OK) {
+    chip->errors++;
+    return false;
+  };
+  return true;
+}
+
+// Ошибка обмена: микросхема откладывается с нарастающей паузой, в журнал - только при отказе и при повторах
+static zone_exp_result_t zoneExpFailed(zone_exp_t* chip)
+{
+  if (chip->fails < UINT8_MAX) chip->fails++;
+  uint32_t delay = ZONEEXP_RETRY_DELAY << (chip->fails < 9 ? chip->fails - 1 : 8);
+  if (delay > ZONEEXP_RETRY_MAX) delay = ZONEEXP_RETRY_MAX;
+  chip->retry_time = esp_timer_get_time() + (int64_t)delay * 1000;
+  if (chip->fails == 1) {
+    rlog_e(logTAG, "Failed to read MCP23017 on bus %d at address 0x%.2X, chip disabled", chip->i2c_num, chip->i2c_address);
+  } else {
+    rlog_w(logTAG, "MCP23017 0x%.2X is still not responding (%d attempts), next retry in %" PRIu32 " ms", chip->i2c_address, chip->fails, delay);
+  };
+  return ZONEEXP_FAILED;
+}
+
+static bool zoneExpPost(zone_exp_t* chip, uint8_t pin, bool state)
+{
+  input_data_t data;
+  memset(&data, 0, sizeof(input_data_t));
+  data.source = IDS_GPIO;
+  data.count = 1;
+  data.gpio.bus = (uint8_t)chip->i2c_num + 1;
+  data.gpio.address = chip->i2c_address;
+  data.gpio.pin = pin;
+  data.gpio.value = state ? 1 : 0;
+  if (!_zoneExpQueue) return false;
+  return xQueueSend(_zoneExpQueue, &data, pdMS_TO_TICKS(100)) == pdPASS;
+}
+
+// Передача в очередь изменившихся входов из mask; если очередь переполнена, изменение будет передано на следующем проходе
+static bool zoneExpPostChanges(zone_exp_t* chip, uint16_t mask, uint16_t levels)
+{
+  bool ret = true;
+  uint16_t changed = (levels ^ chip->state) & mask;
+  for (uint8_t pin = 0; (pin < 16) && (changed != 0); pin++) {
+    uint16_t bit = 1U << pin;
+    if (changed & bit) {
+      changed &= ~bit;
+      if (zoneExpPost(chip, pin, levels & bit)) {
+        chip->state ^= bit;
+        // Время от прерывания до передачи в очередь и отметка начала пути "зона -> сирена"
+        perfRecord(_perfLatency, (uint32_t)esp_timer_get_time() - chip->int_time);
+        if (levels & bit) perfMarkSet(_perfAlarm);
+        rlog_d(logTAG, "MCP23017 0x%.2X pin %d changed to %d", chip->i2c_address, pin, (levels & bit) ? 1 : 0);
+      } else {
+        rlog_e(logTAG, "Failed to send MCP23017 0x%.2X pin %d state to alarm queue", chip->i2c_address, pin);
+        ret = false;
+      };
+    };
+  };
+  return ret;
+}
+
+// Один проход обработки прерывания одной микросхемы (линия INT проверяется вызывающим после прохода по всем микросхемам)
+static zone_exp_result_t zoneExpService(zone_exp_t* chip)
+{
+  // INTF, INTCAP и GPIO обоих портов одной транзакцией; чтение INTCAP/GPIO сбрасывает прерывание
+  uint8_t data[ZONEEXP_BURST_SIZE];
+  if (!zoneExpRead(chip, ZONEEXP_REG_INTFA, data, sizeof(data))) return zoneExpFailed(chip);
+  if (chip->fails > 0) {
+    rlog_i(logTAG, "MCP23017 0x%.2X is responding again", chip->i2c_address);
+    chip->fails = 0;
+  };
+  uint16_t flags = (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+  uint16_t captured = (uint16_t)data[2] | ((uint16_t)data[3] << 8);
+  uint16_t levels = (uint16_t)data[4] | ((uint16_t)data[5] << 8);
+
+  // Прерывание на общей линии запросила другая микросхема: без паузы подавления дребезга
+  if ((flags == 0) && (levels == chip->state)) return ZONEEXP_IDLE;
+
+  bool again = false;
+  if (chip->debounce > 0) {
+    // Новый уровень принимается, если он не изменился за время подавления дребезга
+    vTaskDelay(chip->debounce);
+    uint8_t confirm[2];
+    if (!zoneExpRead(chip, ZONEEXP_REG_GPIOA, confirm, sizeof(confirm))) return zoneExpFailed(chip);
+    uint16_t confirmed = (uint16_t)confirm[0] | ((uint16_t)confirm[1] << 8);
+    uint16_t unstable = levels ^ confirmed;
+    if (unstable) {
+      chip->bounces++;
+      again = true;
+    };
+    if (!zoneExpPostChanges(chip, ~unstable, confirmed)) again = true;
+  } else {
+    // Без подавления дребезга: короткий импульс, завершившийся до чтения, восстанавливается по INTCAP
+    if (!zoneExpPostChanges(chip, flags, captured)) again = true;
+    if (!zoneExpPostChanges(chip, 0xFFFF, levels)) again = true;
+  };
+
+  return again ? ZONEEXP_AGAIN : ZONEEXP_SERVICED;
+}
+
+// Обработка микросхем из mask до освобождения их линий INT. Возвращает маску микросхем, обработка которых отложена
+static uint32_t zoneExpServiceAll(uint32_t mask)
+{
+  uint32_t deferred = 0;
+  uint32_t active = mask;
+  uint8_t passes = 0;
+  while (active) {
+    // Сначала один проход по всем микросхемам, и только затем проверка линий: иначе микросхема, удерживающая
+    // общую линию, заставляла бы повторно (и с паузами подавления дребезга) читать соседние
+    uint32_t again = 0;
+    uint32_t raised = 0;
+    for (uint8_t i = 0; i < _chipsCount; i++) {
+      if (active & (1UL << i)) {
+        switch (zoneExpService(&_chips[i])) {
+          case ZONEEXP_SERVICED: raised |= (1UL << i); break;
+          case ZONEEXP_AGAIN:    raised |= (1UL << i); again |= (1UL << i); break;
+          case ZONEEXP_FAILED:   deferred |= (1UL << i); break;
+          default: break;
+        };
+      };
+    };
+
+    // Прерывание обрабатывается по фронту, поэтому пока линия INT активна, а на ней есть микросхемы, запрашивавшие 
+    // прерывание в этом проходе, - повторяем проход по всем исправным микросхемам этой линии. Если линию удерживает
+    // отложенная (неисправная) микросхема, остальные повторно не читаются до ее следующей попытки
+    for (uint8_t i = 0; i < _chipsCount; i++) {
+      if ((raised & (1UL << i)) && (gpio_get_level((gpio_num_t)_chips[i].int_gpio) == 0)) {
+        for (uint8_t j = 0; j < _chipsCount; j++) {
+          if ((mask & (1UL << j)) && (_chips[j].int_gpio == _chips[i].int_gpio)) again |= (1UL << j);
+        };
+      };
+    };
+    active = again & ~deferred;
+
+    if (active && (++passes >= ZONEEXP_MAX_PASSES)) {
+      // Линия INT не освобождается (непрерывный дребезг или переполнение очереди): повторим после паузы
+      rlog_w(logTAG, "Interrupt is still pending after %d passes", passes);
+      int64_t retry = esp_timer_get_time() + (int64_t)ZONEEXP_RETRY_DELAY * 1000;
+      for (uint8_t i = 0; i < _chipsCount; i++) {
+        if (active & (1UL << i)) _chips[i].retry_time = retry;
+      };
+      deferred |= active;
+      break;
+    };
+  };
+  return deferred;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Задача ------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void zoneExpTaskExec(void *pvParameters)
+{
+  uint32_t notified = 0;
+  uint32_t deferred = 0;
+  TickType_t wait = portMAX_DELAY;
+  while (1) {
+    uint32_t pending = 0;
+    if (xTaskNotifyWait(0, UINT32_MAX, &notified, wait) == pdTRUE) {
+      pending = notified;
+    };
+
+    // Отложенные микросхемы обрабатываются по наступлении времени повтора, прерывания от них до этого игнорируются
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < _chipsCount; i++) {
+      uint32_t bit = 1UL << i;
+      if ((deferred & bit) && (now >= _chips[i].retry_time)) {
+        deferred &= ~bit;
+        pending |= bit;
+      } else if ((pending & bit) && (_chips[i].fails > 0) && (now < _chips[i].retry_time)) {
+        pending &= ~bit;
+        deferred |= bit;
+      };
+    };
+    if (pending) {
+      deferred |= zoneExpServiceAll(pending);
+    };
+
+    // Ожидание до ближайшего повтора
+    wait = portMAX_DELAY;
+    if (deferred) {
+      now = esp_timer_get_time();
+      int64_t next = INT64_MAX;
+      for (uint8_t i = 0; i < _chipsCount; i++) {
+        if ((deferred & (1UL << i)) && (_chips[i].retry_time < next)) next = _chips[i].retry_time;
+      };
+      wait = next > now ? pdMS_TO_TICKS((next - now + 999) / 1000) : 0;
+      if ((wait == 0) && (next > now)) wait = 1;
+    };
+  };
+  vTaskDelete(nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Публичные ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+int8_t zoneExpAdd(i2c_port_t i2c_num, uint8_t i2c_address, uint8_t int_gpio, uint16_t active_low, uint16_t pullups, uint32_t debounce_ms)
+{
+  if (_chipsCount >= CONFIG_ZONEEXP_MAX_CHIPS) {
+    rlog_e(logTAG, "Failed to add MCP23017 0x%.2X: too many chips", i2c_address);
+    return -1;
+  };
+
+  zone_exp_t* chip = &_chips[_chipsCount];
+  memset(chip, 0, sizeof(zone_exp_t));
+  chip->device = new reMCP23017(i2c_num, i2c_address, nullptr);
+  if (chip->device == nullptr) {
+    rlog_e(logTAG, "Failed to create MCP23017 0x%.2X", i2c_address);
+    return -1;
+  };
+  chip->i2c_num = i2c_num;
+  chip->i2c_address = i2c_address;
+  chip->int_gpio = int_gpio;
+  chip->active_low = active_low;
+  chip->pullups = pullups;
+  chip->debounce = pdMS_TO_TICKS(debounce_ms);
+  if ((debounce_ms > 0) && (chip->debounce == 0)) chip->debounce = 1;
+
+  rlog_i(logTAG, "MCP23017 on bus %d at address 0x%.2X added as chip %d (INT on GPIO %d)", i2c_num, i2c_address, _chipsCount, int_gpio);
+  return _chipsCount++;
+}
+
+bool zoneExpStart(QueueHandle_t queue)
+{
+  if (_chipsCount == 0) return false;
+  _zoneExpQueue = queue;
+  _perfLatency = perfRegister("zone_exp_latency");
+  _perfAlarm = perfRegister("zone_to_siren");
+
+  // Задача создается до разрешения прерываний
+  if (_zoneExpTask == nullptr) {
+    _zoneExpTask = xTaskCreateStaticPinnedToCore(zoneExpTaskExec, zoneExpTaskName,
+      CONFIG_ZONEEXP_TASK_STACK_SIZE, NULL, CONFIG_TASK_PRIORITY_IOEXP, _zoneExpTaskStack, &_zoneExpTaskBuffer, CONFIG_TASK_CORE_IOEXP);
+    if (_zoneExpTask) {
+      rloga_i("Task [ %s ] has been successfully created and started", zoneExpTaskName);
+    } else {
+      rloga_e("Failed to create a task for MCP23017 zones!");
+      return false;
+    };
+  };
+
+  // Настройка микросхем: все выводы - входы с прерыванием по любому изменению,
+  // INTA/INTB объединены и работают как открытый сток, чтобы несколько микросхем могли использовать общий вывод
+  for (uint8_t i = 0; i < _chipsCount; i++) {
+    zone_exp_t* chip = &_chips[i];
+    if (!(chip->device->configSet(MCP23017_OPEN_DRAIN, true)
+       && chip->device->portSetMode(0xFFFF)
+       && chip->device->portSetInputPolarity(chip->active_low)
+       && chip->device->portSetPullup(chip->pullups)
+       && chip->device->portSetInterrupt(0xFFFF, MCP23017_INT_ANY_EDGE))) {
+      chip->errors++;
+      rlog_e(logTAG, "Failed to configure MCP23017 on bus %d at address 0x%.2X", chip->i2c_num, chip->i2c_address);
+      continue;
+    };
+
+    // Начальные состояния входов (чтение GPIO заодно сбрасывает прерывание)
+    uint16_t levels = 0;
+    if (chip->device->portRead(&levels)) {
+      chip->state = levels;
+      for (uint8_t pin = 0; pin < 16; pin++) {
+        zoneExpPost(chip, pin, levels & (1U << pin));
+      };
+    } else {
+      chip->errors++;
+    };
+  };
+
+  // Один обработчик на каждый используемый вывод INT, в аргументе - маска микросхем на этом выводе
+  esp_err_t err = gpio_install_isr_service(0);
+  if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) {
+    rlog_e(logTAG, "Failed to install GPIO ISR service: %d %s", err, esp_err_to_name(err));
+    return false;
+  };
+  for (uint8_t i = 0; i < _chipsCount; i++) {
+    bool first = true;
+    uint32_t chips = 0;
+    for (uint8_t j = 0; j < _chipsCount; j++) {
+      if (_chips[j].int_gpio == _chips[i].int_gpio) {
+        if (j < i) first = false;
+        chips |= (1UL << j);
+      };
+    };
+    if (first) {
+      gpio_num_t gpio = (gpio_num_t)_chips[i].int_gpio;
+      gpio_reset_pin(gpio);
+      RE_OK_CHECK(gpio_set_direction(gpio, GPIO_MODE_INPUT), return false);
+      RE_OK_CHECK(gpio_set_pull_mode(gpio, GPIO_PULLUP_ONLY), return false);
+      RE_OK_CHECK(gpio_set_intr_type(gpio, GPIO_INTR_NEGEDGE), return false);
+      RE_OK_CHECK(gpio_isr_handler_add(gpio, zoneExpIsrHandler, (void*)chips), return false);
+      RE_OK_CHECK(gpio_intr_enable(gpio), return false);
+      // Если линия уже активна, фронта не будет - обрабатываем сразу
+      if (gpio_get_level(gpio) == 0) {
+        xTaskNotify(_zoneExpTask, chips, eSetBits);
+      };
+    };
+  };
+
+  rlog_i(logTAG, "MCP23017 zones started: %d chips", _chipsCount);
+  return true;
+}
+
+uint16_t zoneExpGetStates(uint8_t chip)
+{
+  return (chip < _chipsCount) ? _chips[chip].state : 0;
+}
+
+uint32_t zoneExpGetErrors(uint8_t chip)
+{
+  return (chip < _chipsCount) ? _chips[chip].errors : 0;
+}
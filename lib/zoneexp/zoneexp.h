@@ -0,0 +1,74 @@
+/*
+   Модуль проводных зон охраны на расширителях портов MCP23017.
+   Все 16 выводов микросхемы работают как входы с прерыванием по изменению, выходы INTA/INTB объединены (MIRROR)
+   и подключены к выводу ESP32. Опроса шины нет: обработчик прерывания только будит задачу модуля, которая
+   одной транзакцией I2C читает INTF, INTCAP и GPIO обоих портов, подтверждает новые уровни после паузы
+   подавления дребезга и передает изменения напрямую в очередь задачи охранной сигнализации.
+
+   Адрес вывода для alarmSensorAdd(AST_WIRED, ...) формируется так же, как в reMCP23017 и reAlarm:
+   ZONEEXP_SENSOR_ADDRESS(I2C_NUM_0, 0x20, 3) - шина (номер порта + 1), адрес микросхемы, номер вывода 0..15
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __ZONEEXP_H__
+#define __ZONEEXP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "project_config.h"
+
+// Максимальное количество микросхем MCP23017
+#ifndef CONFIG_ZONEEXP_MAX_CHIPS
+#define CONFIG_ZONEEXP_MAX_CHIPS 2
+#endif // CONFIG_ZONEEXP_MAX_CHIPS
+
+// Размер стека задачи обслуживания расширителей
+#ifndef CONFIG_ZONEEXP_TASK_STACK_SIZE
+#define CONFIG_ZONEEXP_TASK_STACK_SIZE 3*1024
+#endif // CONFIG_ZONEEXP_TASK_STACK_SIZE
+
+// Таймаут операций на шине I2C, мс
+#ifndef CONFIG_ZONEEXP_I2C_TIMEOUT
+#define CONFIG_ZONEEXP_I2C_TIMEOUT 100
+#endif // CONFIG_ZONEEXP_I2C_TIMEOUT
+
+// Адрес датчика reAlarm для вывода pin расширителя с адресом address на шине port
+#define ZONEEXP_SENSOR_ADDRESS(port, address, pin) ((((uint32_t)(port) + 1) << 16) | ((uint32_t)(address) << 8) | (uint32_t)(pin))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Добавление микросхемы: шина и адрес, вывод ESP32 для INT, маска активных низким уровнем входов
+ * (инвертируются средствами MCP23017 через IPOL), маска входов с внутренней подтяжкой, время подавления дребезга (мс).
+ * Несколько микросхем могут использовать общий вывод INT. Возвращает номер микросхемы или -1 при ошибке
+ * */
+int8_t zoneExpAdd(i2c_port_t i2c_num, uint8_t i2c_address, uint8_t int_gpio, uint16_t active_low, uint16_t pullups, uint32_t debounce_ms);
+
+/**
+ * Настройка микросхем и запуск задачи: текущие состояния всех входов передаются в очередь queue,
+ * после чего разрешаются прерывания
+ * */
+bool zoneExpStart(QueueHandle_t queue);
+
+/**
+ * Текущая (после подавления дребезга) маска активных входов микросхемы
+ * */
+uint16_t zoneExpGetStates(uint8_t chip);
+
+/**
+ * Количество ошибок обмена с микросхемой с момента запуска
+ * */
+uint32_t zoneExpGetErrors(uint8_t chip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZONEEXP_H__
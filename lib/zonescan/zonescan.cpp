@@ -0,0 +1,247 @@
+#include "zonescan.h"
+#include <string.h>
+#include <inttypes.h>
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "soc/gpio_reg.h"
+#include "rLog.h"
+#include "rTypes.h"
+#include "reEsp32.h"
+#include "perfstat.h"
+
+static const char* logTAG = "ZSCN";
+
+typedef struct {
+  uint8_t gpio;
+  uint8_t active_level;
+  uint16_t debounce;      // Количество проходов, в течение которых новый уровень должен оставаться неизменным
+  uint16_t integrator;    // Счетчик проходов с уровнем, отличным от подтвержденного
+  uint32_t last_edge;     // Время последнего фронта, мкс
+} zone_scan_t;
+
+typedef struct {
+  uint8_t zone;
+  uint32_t time_us;
+} zone_edge_t;
+
+static zone_scan_t _zones[CONFIG_ZONESCAN_MAX_ZONES];
+static uint8_t _zonesCount = 0;
+static uint32_t _zonesStable = 0;
+static uint32_t _bounces = 0;
+static QueueHandle_t _zonesQueue = nullptr;
+static esp_timer_handle_t _scanTimer = nullptr;
+static bool _scanRunning = false;
+static perf_metric_t _perfSettle = PERF_METRIC_NONE;
+static perf_metric_t _perfAlarm = PERF_METRIC_NONE;
+
+// Кольцевой буфер фронтов: пишется только из ISR, читается только из прохода подавления дребезга
+static zone_edge_t _ring[CONFIG_ZONESCAN_RING_SIZE];
+static uint8_t _ringHead = 0;
+static uint8_t _ringTail = 0;
+static bool _ringOverflow = false;
+static portMUX_TYPE _scanMux = portMUX_INITIALIZER_UNLOCKED;
+
+// -----------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------------- Входы -------------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+// Чтение уровней всех зон за одно обращение к регистрам GPIO
+static uint32_t zoneScanReadRaw()
+{
+  uint64_t levels = (uint64_t)REG_READ(GPIO_IN_REG) | ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);
+  uint32_t raw = 0;
+  for (uint8_t i = 0; i < _zonesCount; i++) {
+    if (((levels >> _zones[i].gpio) & 1ULL) == _zones[i].active_level) {
+      raw |= (1UL << i);
+    };
+  };
+  return raw;
+}
+
+// Вызывается из задачи esp_timer, поэтому без ожидания: если очередь заполнена, событие будет отправлено на следующем проходе
+static bool zoneScanPost(uint8_t zone, bool state)
+{
+  input_data_t data;
+  memset(&data, 0, sizeof(input_data_t));
+  data.source = IDS_GPIO;
+  data.count = 1;
+  data.gpio.bus = 0;
+  data.gpio.address = 0;
+  data.gpio.pin = _zones[zone].gpio;
+  data.gpio.value = state ? 1 : 0;
+  if (!_zonesQueue) return false;
+  return xQueueSend(_zonesQueue, &data, 0) == pdPASS;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Прерывание -----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void IRAM_ATTR zoneScanIsrHandler(void* arg)
+{
+  bool start = false;
+  portENTER_CRITICAL_ISR(&_scanMux);
+  uint8_t next = (_ringHead + 1) % CONFIG_ZONESCAN_RING_SIZE;
+  if (next != _ringTail) {
+    _ring[_ringHead].zone = (uint8_t)(uint32_t)arg;
+    _ring[_ringHead].time_us = (uint32_t)esp_timer_get_time();
+    _ringHead = next;
+  } else {
+    _ringOverflow = true;
+  };
+  if (!_scanRunning) {
+    _scanRunning = true;
+    start = true;
+  };
+  portEXIT_CRITICAL_ISR(&_scanMux);
+  // Таймер однократный и к этому моменту гарантированно остановлен
+  if (start) {
+    esp_timer_start_once(_scanTimer, CONFIG_ZONESCAN_PERIOD_US);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------ Подавление дребезга --------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+static void zoneScanPass(void* arg)
+{
+  // Забираем накопленные фронты
+  uint32_t moving = 0;
+  portENTER_CRITICAL(&_scanMux);
+  while (_ringTail != _ringHead) {
+    moving |= (1UL << _ring[_ringTail].zone);
+    _zones[_ring[_ringTail].zone].last_edge = _ring[_ringTail].time_us;
+    _ringTail = (_ringTail + 1) % CONFIG_ZONESCAN_RING_SIZE;
+  };
+  if (_ringOverflow) {
+    _ringOverflow = false;
+    moving = UINT32_MAX;
+  };
+  portEXIT_CRITICAL(&_scanMux);
+
+  // Интеграторы: новый уровень принимается, если он держится не менее debounce проходов подряд
+  uint32_t raw = zoneScanReadRaw();
+  uint32_t diff = raw ^ _zonesStable;
+  uint32_t unstable = 0;
+  for (uint8_t i = 0; i < _zonesCount; i++) {
+    uint32_t bit = 1UL << i;
+    if (diff & bit) {
+      if (_zones[i].integrator < _zones[i].debounce) {
+        _zones[i].integrator++;
+      };
+      if (_zones[i].integrator >= _zones[i].debounce) {
+        // Передаем изменение; если очередь переполнена, повторим на следующем проходе
+        if (zoneScanPost(i, raw & bit)) {
+          _zonesStable ^= bit;
+          _zones[i].integrator = 0;
+          // Время от последнего фронта до передачи в очередь и отметка начала пути "зона -> сирена"
+          perfRecord(_perfSettle, (uint32_t)esp_timer_get_time() - _zones[i].last_edge);
+          if (raw & bit) perfMarkSet(_perfAlarm);
+          rlog_d(logTAG, "Zone %d (GPIO %d) changed to %d, settled %d us after last edge", 
+            i, _zones[i].gpio, (raw & bit) ? 1 : 0, (uint32_t)esp_timer_get_time() - _zones[i].last_edge);
+        } else {
+          rlog_e(logTAG, "Failed to send zone %d state to alarm queue", i);
+          unstable |= bit;
+        };
+      } else {
+        unstable |= bit;
+      };
+    } else {
+      if (_zones[i].integrator > 0) {
+        // Уровень вернулся к подтвержденному до истечения времени - это был дребезг
+        _zones[i].integrator = 0;
+        _bounces++;
+      };
+    };
+  };
+
+  // Продолжаем опрос, пока есть фронты или неподтвержденные уровни
+  bool rearm = false;
+  portENTER_CRITICAL(&_scanMux);
+  if ((unstable != 0) || (moving != 0) || (_ringTail != _ringHead)) {
+    rearm = true;
+  } else {
+    _scanRunning = false;
+  };
+  portEXIT_CRITICAL(&_scanMux);
+  if (rearm) {
+    esp_timer_start_once(_scanTimer, CONFIG_ZONESCAN_PERIOD_US);
+  };
+}
+
+// -----------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------------- Публичные ----------------------------------------------------
+// -----------------------------------------------------------------------------------------------------------------------
+
+int8_t zoneScanAdd(uint8_t gpio_num, uint8_t active_level, bool internal_pull, uint32_t debounce_us)
+{
+  if (_zonesCount >= CONFIG_ZONESCAN_MAX_ZONES) {
+    rlog_e(logTAG, "Failed to add GPIO %d: too many zones", gpio_num);
+    return -1;
+  };
+
+  gpio_num_t gpio = (gpio_num_t)gpio_num;
+  gpio_reset_pin(gpio);
+  RE_OK_CHECK(gpio_set_direction(gpio, GPIO_MODE_INPUT), return -1);
+  if (internal_pull) {
+    RE_OK_CHECK(gpio_set_pull_mode(gpio, active_level ? GPIO_PULLDOWN_ONLY : GPIO_PULLUP_ONLY), return -1);
+  } else {
+    RE_OK_CHECK(gpio_set_pull_mode(gpio, GPIO_FLOATING), return -1);
+  };
+
+  zone_scan_t* zone = &_zones[_zonesCount];
+  zone->gpio = gpio_num;
+  zone->active_level = active_level ? 1 : 0;
+  zone->debounce = (debounce_us + CONFIG_ZONESCAN_PERIOD_US - 1) / CONFIG_ZONESCAN_PERIOD_US;
+  if (zone->debounce == 0) zone->debounce = 1;
+  zone->integrator = 0;
+  zone->last_edge = 0;
+
+  rlog_i(logTAG, "GPIO %d added as zone %d", gpio_num, _zonesCount);
+  return _zonesCount++;
+}
+
+bool zoneScanStart(QueueHandle_t queue)
+{
+  _zonesQueue = queue;
+  _perfSettle = perfRegister("zone_settle");
+  _perfAlarm = perfRegister("zone_to_siren");
+
+  if (!_scanTimer) {
+    esp_timer_create_args_t tmr_cfg;
+    memset(&tmr_cfg, 0, sizeof(tmr_cfg));
+    tmr_cfg.callback = zoneScanPass;
+    tmr_cfg.dispatch_method = ESP_TIMER_TASK;
+    tmr_cfg.name = "zonescan";
+    tmr_cfg.skip_unhandled_events = false;
+    RE_OK_CHECK(esp_timer_create(&tmr_cfg, &_scanTimer), return false);
+  };
+
+  // Начальные состояния зон
+  _zonesStable = zoneScanReadRaw();
+  for (uint8_t i = 0; i < _zonesCount; i++) {
+    zoneScanPost(i, _zonesStable & (1UL << i));
+  };
+
+  // Один и тот же обработчик для всех зон, номер зоны передается в аргументе
+  esp_err_t err = gpio_install_isr_service(0);
+  if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) {
+    rlog_e(logTAG, "Failed to install GPIO ISR service: %d %s", err, esp_err_to_name(err));
+    return false;
+  };
+  for (uint8_t i = 0; i < _zonesCount; i++) {
+    gpio_num_t gpio = (gpio_num_t)_zones[i].gpio;
+    RE_OK_CHECK(gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE), return false);
+    RE_OK_CHECK(gpio_isr_handler_add(gpio, zoneScanIsrHandler, (void*)(uint32_t)i), return false);
+    RE_OK_CHECK(gpio_intr_enable(gpio), return false);
+  };
+
+  rlog_i(logTAG, "Zone scanner started: %d zones, states 0x%.8X", _zonesCount, _zonesStable);
+  return true;
+}
+
+bool zoneScanStatsAppend(scratch_arena_t* arena, char** json)
+{
+  return scratchAppendf(arena, json, nullptr, "{\"zones\":%d,\"bounces\":%" PRIu32 "}", _zonesCount, _bounces);
+}
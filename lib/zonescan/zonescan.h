@@ -0,0 +1,61 @@
+/*
+   Модуль опроса проводных зон охраны с общим подавлением дребезга.
+   Все входы обслуживаются одним обработчиком прерываний, который только записывает фронты в кольцевой буфер.
+   Подавление дребезга выполняется одним таймером сразу для всех зон (битовые маски + интеграторы),
+   который работает только пока есть активность на входах. Изменения, накопленные за один проход,
+   передаются пачкой напрямую в очередь задачи охранной сигнализации, минуя общий цикл событий
+   --------------------------
+   (с) 2021-2024 Разживин Александр | Razzhivin Alexander
+   kotyara12@yandex.ru | https://kotyara12.ru | tg: @kotyara1971
+*/
+
+#ifndef __ZONESCAN_H__
+#define __ZONESCAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "project_config.h"
+#include "scratch.h"
+
+// Максимальное количество зон (не более 32 - по количеству бит в маске)
+#ifndef CONFIG_ZONESCAN_MAX_ZONES
+#define CONFIG_ZONESCAN_MAX_ZONES 8
+#endif // CONFIG_ZONESCAN_MAX_ZONES
+
+// Период прохода подавления дребезга, мкс
+#ifndef CONFIG_ZONESCAN_PERIOD_US
+#define CONFIG_ZONESCAN_PERIOD_US 10000
+#endif // CONFIG_ZONESCAN_PERIOD_US
+
+// Размер кольцевого буфера фронтов
+#ifndef CONFIG_ZONESCAN_RING_SIZE
+#define CONFIG_ZONESCAN_RING_SIZE 32
+#endif // CONFIG_ZONESCAN_RING_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Добавление зоны: вывод, активный уровень, внутренняя подтяжка, время подавления дребезга (мкс).
+ * Возвращает номер зоны или -1 при ошибке
+ * */
+int8_t zoneScanAdd(uint8_t gpio_num, uint8_t active_level, bool internal_pull, uint32_t debounce_us);
+
+/**
+ * Запуск опроса: текущие состояния всех зон передаются в очередь queue, после чего разрешаются прерывания
+ * */
+bool zoneScanStart(QueueHandle_t queue);
+
+/**
+ * Количество фронтов, отброшенных как дребезг, с момента запуска в формате JSON (раздел метрик производительности)
+ * */
+bool zoneScanStatsAppend(scratch_arena_t* arena, char** json);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ZONESCAN_H__
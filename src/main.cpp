@@ -22,10 +22,15 @@
 #include "reMqtt.h"
 #include "reSysInfo.h"
 #include "reScheduler.h"
+#include "timesched.h"
 #include "reI2C.h"
 #include "reCerts.h"
 #if CONFIG_PINGER_ENABLE
+#if CONFIG_NETPROBE_ENABLE
+#include "netprobe.h"
+#else
 #include "rePinger.h"
+#endif // CONFIG_NETPROBE_ENABLE
 #endif // CONFIG_PINGER_ENABLE
 #if CONFIG_TELEGRAM_ENABLE
 #include "reTgSend.h"
@@ -41,6 +46,10 @@
 #endif // CONFIG_ELTARIFFS_ENABLED
 #include "sensors.h"
 #include "security.h"
+#include "otaresume.h"
+#include "tlscache.h"
+#include "perfstat.h"
+#include "i2cbatch.h"
 
 // Главная функция
 extern "C" { void app_main(void) 
@@ -97,9 +106,22 @@ extern "C" { void app_main(void)
   schedulerEventHandlerRegister();
   vTaskDelay(1);
 
+  // Регистрируем службу расписаний с заранее вычисленными моментами переключения
+  timeSchedEventHandlerRegister();
+  vTaskDelay(1);
+
+  // Регистрируем службу публикации метрик производительности и статистику устройств I2C в ее составе
+  perfEventHandlerRegister();
+  perfSectionRegister("i2c", i2cBatchStatsAppend);
+  vTaskDelay(1);
+
   #if CONFIG_PINGER_ENABLE
     // Регистрация службы периодической проверки внешних серверов и доступа к сети интернет
-    pingerEventHandlerRegister();
+    #if CONFIG_NETPROBE_ENABLE
+      netprobeEventHandlerRegister();
+    #else
+      pingerEventHandlerRegister();
+    #endif // CONFIG_NETPROBE_ENABLE
     vTaskDelay(1);
   #endif // CONFIG_PINGER_ENABLE
 
@@ -107,6 +129,10 @@ extern "C" { void app_main(void)
   sntpTaskCreate(true);
   vTaskDelay(1);
 
+  // Публикация статистики кэша TLS-сессий при подключении к брокеру
+  tlsCacheEventHandlerRegister();
+  vTaskDelay(1);
+
   // Запуск и регистрация MQTT слиента
   mqttTaskStart(true);
   vTaskDelay(1);